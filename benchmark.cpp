@@ -0,0 +1,450 @@
+#include <algorithm>
+#include <glib-object.h>
+#include <glib.h>
+#include <gst/gst.h>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/resource.h>
+#include <unordered_map>
+#include <vector>
+
+typedef struct {
+  std::vector<std::string> SOURCES;
+  std::vector<std::pair<int, int>> RESOLUTIONS;
+  std::vector<std::string> CONFIGS;
+  std::string FORMAT;
+  std::string EYEIMG_PATH;
+  gint NUM_BUFFERS;
+  std::string OUTPUT;
+} Arguments;
+
+typedef struct {
+  std::mutex lock;
+  std::unordered_map<GstClockTime, GstClockTime> entered;
+  std::vector<double> latencies;
+  guint64 frames;
+} FrameTimes;
+
+typedef struct {
+  std::string source;
+  int width;
+  int height;
+  std::string config;
+  gboolean ok;
+  guint64 frames;
+  double wall_time;
+  double cpu_user;
+  double cpu_system;
+  std::vector<double> latencies;
+  GstStructure *stats;
+} RunResult;
+
+static Arguments parse_args(int argc, char *argv[]);
+static RunResult run_benchmark(const Arguments &args,
+                               const std::string &source, int width,
+                               int height, const std::string &config);
+static gboolean apply_config(GstElement *sticker, const std::string &config);
+static GstPadProbeReturn on_sink_buffer(GstPad *pad, GstPadProbeInfo *info,
+                                        gpointer user_data);
+static GstPadProbeReturn on_src_buffer(GstPad *pad, GstPadProbeInfo *info,
+                                       gpointer user_data);
+static double cpu_seconds(const struct timeval &tv);
+static void write_json(GString *json, const std::vector<RunResult> &results);
+static std::vector<std::string> split(const std::string &text, char delim);
+
+/* Runs face_sticker headless over every combination of source, resolution
+ * and property set and writes fps, per-frame latency and CPU time as JSON.
+ *
+ *   ./build/benchmark sources=test,clip.mp4 resolutions=640x480,1920x1080 \
+ *       configs="detection_interval=1;async_detection=TRUE,detection_width=480"
+ */
+int main(int argc, char *argv[]) {
+  Arguments args = parse_args(argc, argv);
+  std::vector<RunResult> results;
+
+  gst_init(&argc, &argv);
+
+  for (const std::string &source : args.SOURCES) {
+    for (const std::pair<int, int> &resolution : args.RESOLUTIONS) {
+      for (const std::string &config : args.CONFIGS) {
+        g_printerr("%s %dx%d [%s]...\n", source.c_str(), resolution.first,
+                   resolution.second, config.c_str());
+
+        RunResult result = run_benchmark(args, source, resolution.first,
+                                         resolution.second, config);
+        if (result.ok) {
+          g_printerr("  %" G_GUINT64_FORMAT " frames, %.1f fps\n",
+                     result.frames,
+                     result.wall_time > 0 ? result.frames / result.wall_time
+                                          : 0.0);
+        }
+        results.push_back(std::move(result));
+      }
+    }
+  }
+
+  GString *json = g_string_new(NULL);
+  write_json(json, results);
+
+  int status = 0;
+  if (args.OUTPUT == "-") {
+    fputs(json->str, stdout);
+  } else if (!g_file_set_contents(args.OUTPUT.c_str(), json->str, json->len,
+                                  NULL)) {
+    g_printerr("Could not write %s.\n", args.OUTPUT.c_str());
+    status = -1;
+  } else {
+    g_printerr("Results written to %s\n", args.OUTPUT.c_str());
+  }
+
+  g_string_free(json, TRUE);
+  for (RunResult &result : results) {
+    if (result.stats) {
+      gst_structure_free(result.stats);
+    }
+  }
+
+  return status;
+}
+
+static RunResult run_benchmark(const Arguments &args,
+                               const std::string &source, int width,
+                               int height, const std::string &config) {
+  RunResult result = {source, width, height, config, FALSE, 0, 0, 0, 0,
+                      {},     NULL};
+  gboolean test_source = source == "test";
+  GError *error = NULL;
+
+  /* files are decoded and scaled, the test pattern is generated at the
+   * requested size; either way face_sticker sees the requested format */
+  gchar *description = g_strdup_printf(
+      "%s ! videoconvert ! videoscale ! "
+      "video/x-raw,format=%s,width=%d,height=%d ! "
+      "face_sticker name=sticker ! fakesink name=sink sync=false",
+      test_source ? "videotestsrc name=source pattern=ball"
+                  : "filesrc name=source ! decodebin",
+      args.FORMAT.c_str(), width, height);
+  GstElement *pipeline = gst_parse_launch(description, &error);
+  g_free(description);
+
+  if (!pipeline) {
+    g_printerr("Pipeline could not be created: %s\n", error->message);
+    g_error_free(error);
+    return result;
+  }
+
+  GstElement *src = gst_bin_get_by_name(GST_BIN(pipeline), "source");
+  GstElement *sticker = gst_bin_get_by_name(GST_BIN(pipeline), "sticker");
+
+  if (test_source) {
+    g_object_set(src, "num-buffers", args.NUM_BUFFERS, NULL);
+  } else {
+    g_object_set(src, "location", source.c_str(), NULL);
+  }
+  g_object_set(sticker, "silent", TRUE, "eye_img_path",
+               args.EYEIMG_PATH.c_str(), NULL);
+
+  if (!apply_config(sticker, config)) {
+    gst_object_unref(src);
+    gst_object_unref(sticker);
+    gst_object_unref(pipeline);
+    return result;
+  }
+
+  /* latency is measured from the buffer entering face_sticker to it leaving,
+   * matched by PTS */
+  FrameTimes times;
+  times.frames = 0;
+
+  GstPad *sink_pad = gst_element_get_static_pad(sticker, "sink");
+  GstPad *src_pad = gst_element_get_static_pad(sticker, "src");
+  gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, on_sink_buffer,
+                    &times, NULL);
+  gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, on_src_buffer, &times,
+                    NULL);
+  gst_object_unref(sink_pad);
+  gst_object_unref(src_pad);
+
+  struct rusage usage_start, usage_end;
+  getrusage(RUSAGE_SELF, &usage_start);
+  gint64 wall_start = g_get_monotonic_time();
+
+  if (gst_element_set_state(pipeline, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE) {
+    g_printerr("Unable to set the pipeline to the playing state.\n");
+  } else {
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(
+        bus, GST_CLOCK_TIME_NONE,
+        (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+      GError *err = NULL;
+      gst_message_parse_error(msg, &err, NULL);
+      g_printerr("Error from %s: %s\n", GST_OBJECT_NAME(msg->src),
+                 err->message);
+      g_error_free(err);
+    } else {
+      result.ok = TRUE;
+    }
+
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+  }
+
+  gint64 wall_end = g_get_monotonic_time();
+  getrusage(RUSAGE_SELF, &usage_end);
+
+  if (result.ok) {
+    g_object_get(sticker, "stats", &result.stats, NULL);
+  }
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(src);
+  gst_object_unref(sticker);
+  gst_object_unref(pipeline);
+
+  result.frames = times.frames;
+  result.latencies = std::move(times.latencies);
+  result.wall_time = (wall_end - wall_start) / (double)G_USEC_PER_SEC;
+  result.cpu_user =
+      cpu_seconds(usage_end.ru_utime) - cpu_seconds(usage_start.ru_utime);
+  result.cpu_system =
+      cpu_seconds(usage_end.ru_stime) - cpu_seconds(usage_start.ru_stime);
+
+  return result;
+}
+
+/* Sets the comma separated property=value pairs of @config on @sticker. */
+static gboolean apply_config(GstElement *sticker, const std::string &config) {
+  for (const std::string &assignment : split(config, ',')) {
+    size_t pos = assignment.find('=');
+    if (pos == std::string::npos) {
+      g_printerr("Invalid property assignment '%s'.\n", assignment.c_str());
+      return FALSE;
+    }
+
+    std::string key = assignment.substr(0, pos);
+    std::string value = assignment.substr(pos + 1);
+
+    if (!g_object_class_find_property(G_OBJECT_GET_CLASS(sticker),
+                                      key.c_str())) {
+      g_printerr("face_sticker has no property '%s'.\n", key.c_str());
+      return FALSE;
+    }
+    gst_util_set_object_arg(G_OBJECT(sticker), key.c_str(), value.c_str());
+  }
+
+  return TRUE;
+}
+
+static GstPadProbeReturn on_sink_buffer(GstPad *pad, GstPadProbeInfo *info,
+                                        gpointer user_data) {
+  FrameTimes *times = (FrameTimes *)user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+  std::lock_guard<std::mutex> guard(times->lock);
+  times->entered[GST_BUFFER_PTS(buffer)] = gst_util_get_timestamp();
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn on_src_buffer(GstPad *pad, GstPadProbeInfo *info,
+                                       gpointer user_data) {
+  FrameTimes *times = (FrameTimes *)user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  GstClockTime now = gst_util_get_timestamp();
+
+  std::lock_guard<std::mutex> guard(times->lock);
+  times->frames++;
+
+  auto it = times->entered.find(GST_BUFFER_PTS(buffer));
+  if (it != times->entered.end()) {
+    times->latencies.push_back((now - it->second) / (double)GST_MSECOND);
+    times->entered.erase(it);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static double cpu_seconds(const struct timeval &tv) {
+  return tv.tv_sec + tv.tv_usec / (double)G_USEC_PER_SEC;
+}
+
+static double percentile(const std::vector<double> &sorted, int p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[(sorted.size() - 1) * p / 100];
+}
+
+static void append_json_string(GString *json, const std::string &text) {
+  g_string_append_c(json, '"');
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      g_string_append_c(json, '\\');
+      g_string_append_c(json, c);
+    } else if ((unsigned char)c < 0x20) {
+      g_string_append_printf(json, "\\u%04x", c);
+    } else {
+      g_string_append_c(json, c);
+    }
+  }
+  g_string_append_c(json, '"');
+}
+
+static gboolean append_json_stat(GQuark field, const GValue *value,
+                                 gpointer user_data) {
+  GString *json = (GString *)user_data;
+  guint64 number;
+
+  if (G_VALUE_HOLDS_UINT64(value)) {
+    number = g_value_get_uint64(value);
+  } else if (G_VALUE_HOLDS_UINT(value)) {
+    number = g_value_get_uint(value);
+  } else {
+    return TRUE;
+  }
+
+  if (json->str[json->len - 1] != '{') {
+    g_string_append(json, ", ");
+  }
+  append_json_string(json, g_quark_to_string(field));
+  g_string_append_printf(json, ": %" G_GUINT64_FORMAT, number);
+
+  return TRUE;
+}
+
+static void write_json(GString *json, const std::vector<RunResult> &results) {
+  g_string_append(json, "{\n  \"runs\": [");
+
+  for (size_t i = 0; i < results.size(); i++) {
+    const RunResult &result = results[i];
+    std::vector<double> sorted = result.latencies;
+    std::sort(sorted.begin(), sorted.end());
+
+    double mean = 0;
+    for (double latency : sorted) {
+      mean += latency;
+    }
+    if (!sorted.empty()) {
+      mean /= sorted.size();
+    }
+
+    g_string_append(json, i ? ",\n    {" : "\n    {");
+    g_string_append(json, "\n      \"source\": ");
+    append_json_string(json, result.source);
+    g_string_append_printf(json, ",\n      \"width\": %d", result.width);
+    g_string_append_printf(json, ",\n      \"height\": %d", result.height);
+    g_string_append(json, ",\n      \"config\": ");
+    append_json_string(json, result.config);
+    g_string_append_printf(json, ",\n      \"ok\": %s",
+                           result.ok ? "true" : "false");
+    g_string_append_printf(json, ",\n      \"frames\": %" G_GUINT64_FORMAT,
+                           result.frames);
+    g_string_append_printf(json, ",\n      \"wall_time_s\": %.6f",
+                           result.wall_time);
+    g_string_append_printf(
+        json, ",\n      \"fps\": %.3f",
+        result.wall_time > 0 ? result.frames / result.wall_time : 0.0);
+    g_string_append_printf(json, ",\n      \"cpu_user_s\": %.6f",
+                           result.cpu_user);
+    g_string_append_printf(json, ",\n      \"cpu_system_s\": %.6f",
+                           result.cpu_system);
+    g_string_append_printf(
+        json,
+        ",\n      \"latency_ms\": {\"min\": %.3f, \"mean\": %.3f, "
+        "\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}",
+        sorted.empty() ? 0.0 : sorted.front(), mean, percentile(sorted, 50),
+        percentile(sorted, 95), percentile(sorted, 99),
+        sorted.empty() ? 0.0 : sorted.back());
+
+    g_string_append(json, ",\n      \"stats\": {");
+    if (result.stats) {
+      gst_structure_foreach(result.stats, append_json_stat, json);
+    }
+    g_string_append(json, "}\n    }");
+  }
+
+  g_string_append(json, "\n  ]\n}\n");
+}
+
+static std::vector<std::string> split(const std::string &text, char delim) {
+  std::vector<std::string> parts;
+  size_t start = 0;
+
+  while (start <= text.size()) {
+    size_t end = text.find(delim, start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    if (end > start) {
+      parts.push_back(text.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+
+  return parts;
+}
+
+static Arguments parse_args(int argc, char *argv[]) {
+  Arguments args;
+  std::map<std::string, std::string> args_map;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t pos = arg.find('=');
+
+    if (pos != std::string::npos) {
+      std::string key = arg.substr(0, pos);
+      std::string value = arg.substr(pos + 1);
+      args_map[key] = value;
+    }
+  }
+
+  if (args_map.find("sources") != args_map.end()) {
+    args.SOURCES = split(args_map["sources"], ',');
+  } else {
+    args.SOURCES = {"test"};
+  }
+  if (args_map.find("resolutions") != args_map.end()) {
+    for (const std::string &resolution :
+         split(args_map["resolutions"], ',')) {
+      int width, height;
+      if (sscanf(resolution.c_str(), "%dx%d", &width, &height) == 2) {
+        args.RESOLUTIONS.push_back({width, height});
+      }
+    }
+  } else {
+    args.RESOLUTIONS = {{640, 480}, {1280, 720}, {1920, 1080}};
+  }
+  if (args_map.find("configs") != args_map.end()) {
+    args.CONFIGS = split(args_map["configs"], ';');
+  }
+  if (args.CONFIGS.empty()) {
+    args.CONFIGS = {""};
+  }
+  if (args_map.find("format") != args_map.end()) {
+    args.FORMAT = args_map["format"];
+  } else {
+    args.FORMAT = "BGR";
+  }
+  if (args_map.find("eye_img_path") != args_map.end()) {
+    args.EYEIMG_PATH = args_map["eye_img_path"];
+  }
+  if (args_map.find("num_buffers") != args_map.end()) {
+    args.NUM_BUFFERS = std::stoi(args_map["num_buffers"]);
+  } else {
+    args.NUM_BUFFERS = 300;
+  }
+  if (args_map.find("output") != args_map.end()) {
+    args.OUTPUT = args_map["output"];
+  } else {
+    args.OUTPUT = "benchmark.json";
+  }
+
+  return args;
+}
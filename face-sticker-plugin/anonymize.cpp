@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "anonymize.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ANONYMIZE_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ANONYMIZE_NEON 1
+#endif
+
+/* Both effects are built from running column sums: whole rows are added to
+ * and removed from one array of 32-bit sums, a loop that streams through
+ * memory in order and is vectorized below. Horizontal filtering is done the
+ * same way on the transposed region. */
+static thread_local std::vector<uint32_t> column_sums;
+static thread_local std::vector<uint8_t> cell_row;
+static thread_local cv::Mat work;
+static thread_local cv::Mat transposed;
+
+/* sums[i] += add[i] - sub[i], @sub may be NULL */
+static void slide_row(uint32_t *sums, const uint8_t *add, const uint8_t *sub,
+                      size_t n) {
+  size_t i = 0;
+
+#if defined(ANONYMIZE_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(add + i));
+    __m128i s = sub ? _mm_loadu_si128((const __m128i *)(sub + i)) : zero;
+
+    /* differences are within -255..255, sign extended to 32 bits */
+    __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero),
+                               _mm_unpacklo_epi8(s, zero));
+    __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero),
+                               _mm_unpackhi_epi8(s, zero));
+    __m128i d[4] = {_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16),
+                    _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16),
+                    _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16),
+                    _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)};
+
+    for (int k = 0; k < 4; k++) {
+      __m128i *sum = (__m128i *)(sums + i + 4 * k);
+      _mm_storeu_si128(sum, _mm_add_epi32(_mm_loadu_si128(sum), d[k]));
+    }
+  }
+#elif defined(ANONYMIZE_NEON)
+  const uint8x16_t zero = vdupq_n_u8(0);
+
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t a = vld1q_u8(add + i);
+    uint8x16_t s = sub ? vld1q_u8(sub + i) : zero;
+
+    int16x8_t lo =
+        vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(a), vget_low_u8(s)));
+    int16x8_t hi =
+        vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(a), vget_high_u8(s)));
+    int16x4_t d[4] = {vget_low_s16(lo), vget_high_s16(lo), vget_low_s16(hi),
+                      vget_high_s16(hi)};
+
+    for (int k = 0; k < 4; k++) {
+      int32x4_t sum = vreinterpretq_s32_u32(vld1q_u32(sums + i + 4 * k));
+      vst1q_u32(sums + i + 4 * k,
+                vreinterpretq_u32_s32(vaddw_s16(sum, d[k])));
+    }
+  }
+#endif
+
+  for (; i < n; i++) {
+    sums[i] += add[i] - (sub ? sub[i] : 0);
+  }
+}
+
+/* dst[i] = sums[i] * scale, rounded */
+static void scale_row(uint8_t *dst, const uint32_t *sums, float scale,
+                      size_t n) {
+  size_t i = 0;
+
+#if defined(ANONYMIZE_SSE2)
+  const __m128 factor = _mm_set1_ps(scale);
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i v[4];
+
+    for (int k = 0; k < 4; k++) {
+      __m128 sum = _mm_cvtepi32_ps(
+          _mm_loadu_si128((const __m128i *)(sums + i + 4 * k)));
+      v[k] = _mm_cvtps_epi32(_mm_mul_ps(sum, factor));
+    }
+
+    __m128i lo = _mm_packs_epi32(v[0], v[1]);
+    __m128i hi = _mm_packs_epi32(v[2], v[3]);
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(ANONYMIZE_NEON)
+  const float32x4_t factor = vdupq_n_f32(scale);
+  const float32x4_t half = vdupq_n_f32(0.5f);
+
+  for (; i + 16 <= n; i += 16) {
+    uint16x4_t v[4];
+
+    for (int k = 0; k < 4; k++) {
+      float32x4_t sum = vcvtq_f32_u32(vld1q_u32(sums + i + 4 * k));
+      v[k] = vqmovn_u32(vcvtq_u32_f32(vmlaq_f32(half, sum, factor)));
+    }
+
+    vst1q_u8(dst + i, vcombine_u8(vqmovn_u16(vcombine_u16(v[0], v[1])),
+                                  vqmovn_u16(vcombine_u16(v[2], v[3]))));
+  }
+#endif
+
+  for (; i < n; i++) {
+    dst[i] = (uint8_t)std::min(sums[i] * scale + 0.5f, 255.0f);
+  }
+}
+
+void anonymize_pixelate(cv::Mat &roi, int block) {
+  int channels = roi.channels();
+  size_t n = (size_t)roi.cols * channels;
+
+  if (roi.empty() || block < 2) {
+    return;
+  }
+
+  column_sums.resize(n);
+  cell_row.resize(n);
+  uint32_t *sums = column_sums.data();
+
+  for (int y0 = 0; y0 < roi.rows; y0 += block) {
+    int rows = std::min(block, roi.rows - y0);
+
+    std::fill(sums, sums + n, 0);
+    for (int y = y0; y < y0 + rows; y++) {
+      slide_row(sums, roi.ptr(y), NULL, n);
+    }
+
+    /* a band of cells is one row of averages repeated */
+    for (int x0 = 0; x0 < roi.cols; x0 += block) {
+      int cols = std::min(block, roi.cols - x0);
+      float scale = 1.0f / (rows * cols);
+
+      for (int c = 0; c < channels; c++) {
+        uint32_t total = 0;
+
+        for (int x = x0; x < x0 + cols; x++) {
+          total += sums[x * channels + c];
+        }
+
+        uint8_t value = (uint8_t)(total * scale + 0.5f);
+        for (int x = x0; x < x0 + cols; x++) {
+          cell_row[x * channels + c] = value;
+        }
+      }
+    }
+
+    for (int y = y0; y < y0 + rows; y++) {
+      memcpy(roi.ptr(y), cell_row.data(), n);
+    }
+  }
+}
+
+/* One vertical box blur from @src into @dst, which must differ. Each output
+ * row costs one row added and one removed, whatever the radius. */
+static void box_columns(const cv::Mat &src, cv::Mat &dst, int radius) {
+  size_t n = (size_t)src.cols * src.elemSize();
+  int last = src.rows - 1;
+  float scale = 1.0f / (2 * radius + 1);
+
+  column_sums.assign(n, 0);
+  uint32_t *sums = column_sums.data();
+
+  /* window centred on row 0, with the top edge repeated */
+  for (int k = -radius; k <= radius; k++) {
+    slide_row(sums, src.ptr(std::clamp(k, 0, last)), NULL, n);
+  }
+
+  for (int y = 0; y <= last; y++) {
+    scale_row(dst.ptr(y), sums, scale, n);
+    slide_row(sums, src.ptr(std::min(y + radius + 1, last)),
+              src.ptr(std::max(y - radius, 0)), n);
+  }
+}
+
+/* Runs @passes vertical box blurs over @image in place. */
+static void box_passes(cv::Mat &image, int radius, int passes) {
+  radius = std::min(radius, image.rows);
+  work.create(image.size(), image.type());
+
+  for (int pass = 0; pass < passes; pass++) {
+    if (pass % 2 == 0) {
+      box_columns(image, work, radius);
+    } else {
+      box_columns(work, image, radius);
+    }
+  }
+
+  if (passes % 2) {
+    work.copyTo(image);
+  }
+}
+
+/* Box filters along different axes commute, so all vertical passes run
+ * first, then all horizontal ones as vertical passes over the transposed
+ * region. */
+void anonymize_blur(cv::Mat &roi, int radius, int passes) {
+  if (roi.empty() || radius < 1 || passes < 1) {
+    return;
+  }
+
+  box_passes(roi, radius, passes);
+
+  cv::transpose(roi, transposed);
+  box_passes(transposed, radius, passes);
+  cv::transpose(transposed, roi);
+}
@@ -0,0 +1,22 @@
+#ifndef __ANONYMIZE_H__
+#define __ANONYMIZE_H__
+
+#include <opencv2/core/mat.hpp>
+
+/* In-place face anonymization kernels.
+ *
+ * Both work on a view into one frame plane (8-bit, any number of
+ * interleaved channels, e.g. a BGR frame, a luma plane or an NV12 UV plane)
+ * and only touch the pixels inside it. Their cost grows with the area of
+ * the region, not with the block size or blur radius. Scratch memory is
+ * kept per thread, so several frames may be processed at once. */
+
+/* Replaces each @block x @block cell of @roi, counted from its top left
+ * corner, with the cell's average. */
+void anonymize_pixelate(cv::Mat &roi, int block);
+
+/* Applies @passes separable box blurs of the given @radius to @roi, edge
+ * pixels repeated. Three passes come close to a Gaussian blur. */
+void anonymize_blur(cv::Mat &roi, int radius, int passes);
+
+#endif /* __ANONYMIZE_H__ */
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <stdlib.h>
+
+#include "detectionpool.hpp"
+#include "gstfacesticker.hpp"
+#include "inferencethreads.hpp"
+
+DetectionPool::DetectionPool(int n_threads, const std::vector<int> &cpus)
+    : cpus(cpus), running(true), func(NULL), n_jobs(0), next_job(0),
+      pending(0) {
+  n_threads = std::max(n_threads, 1);
+
+  for (int i = 0; i < n_threads; i++) {
+    scratch.push_back((unsigned char *)malloc(DETECT_BUFFER_SIZE));
+  }
+  for (int i = 0; i < n_threads; i++) {
+    threads.emplace_back(&DetectionPool::work, this, i);
+  }
+}
+
+DetectionPool::~DetectionPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    running = false;
+  }
+  job_cond.notify_all();
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (unsigned char *buffer : scratch) {
+    free(buffer);
+  }
+}
+
+void DetectionPool::run(int count, const JobFunc &job_func) {
+  if (count <= 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> run_guard(run_lock);
+  std::unique_lock<std::mutex> guard(lock);
+
+  func = &job_func;
+  n_jobs = count;
+  next_job = 0;
+  pending = count;
+
+  job_cond.notify_all();
+  done_cond.wait(guard, [this] { return pending == 0; });
+
+  func = NULL;
+  n_jobs = 0;
+  next_job = 0;
+}
+
+void DetectionPool::work(int index) {
+  inference_threads_pin(cpus);
+
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (true) {
+    job_cond.wait(guard, [this] { return !running || next_job < n_jobs; });
+    if (!running) {
+      break;
+    }
+
+    int job = next_job++;
+    const JobFunc *job_func = func;
+
+    guard.unlock();
+    if (scratch[index]) {
+      (*job_func)(scratch[index], job);
+    }
+    guard.lock();
+
+    if (--pending == 0) {
+      done_cond.notify_all();
+    }
+  }
+}
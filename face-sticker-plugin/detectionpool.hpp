@@ -0,0 +1,50 @@
+#ifndef __DETECTION_POOL_H__
+#define __DETECTION_POOL_H__
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A fixed set of detection threads, each owning a DETECT_BUFFER_SIZE scratch
+ * buffer so that several facedetect_cnn calls can run at once. The threads
+ * are pinned to @cpus unless it is empty.
+ *
+ * run() hands out @count jobs to the threads and returns once all of them
+ * have finished. Concurrent run() calls are serialized. */
+class DetectionPool {
+public:
+  typedef std::function<void(unsigned char *scratch, int job)> JobFunc;
+
+  DetectionPool(int n_threads, const std::vector<int> &cpus);
+  ~DetectionPool();
+
+  DetectionPool(const DetectionPool &) = delete;
+  DetectionPool &operator=(const DetectionPool &) = delete;
+
+  int size() const { return (int)threads.size(); }
+
+  void run(int count, const JobFunc &func);
+
+private:
+  void work(int index);
+
+  std::vector<std::thread> threads;
+  std::vector<unsigned char *> scratch;
+  std::vector<int> cpus;
+
+  std::mutex run_lock;
+
+  std::mutex lock;
+  std::condition_variable job_cond;
+  std::condition_variable done_cond;
+  bool running;
+
+  const JobFunc *func;
+  int n_jobs;
+  int next_job;
+  int pending;
+};
+
+#endif /* __DETECTION_POOL_H__ */
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <stdlib.h>
+
+#include "detectionservice.hpp"
+#include "gstfacesticker.hpp"
+
+#define DETECTION_SERVICE_QUEUE_SIZE 32
+
+static std::mutex service_lock;
+static DetectionService *service_instance = NULL;
+static guint service_refcount = 0;
+
+DetectionService *
+DetectionService::acquire(const InferenceThreadConfig &config) {
+  std::lock_guard<std::mutex> guard(service_lock);
+
+  if (service_refcount++ == 0) {
+    service_instance = new DetectionService(config);
+  }
+
+  return service_instance;
+}
+
+void DetectionService::release() {
+  DetectionService *instance = NULL;
+
+  {
+    std::lock_guard<std::mutex> guard(service_lock);
+    if (--service_refcount == 0) {
+      instance = service_instance;
+      service_instance = NULL;
+    }
+  }
+
+  delete instance;
+}
+
+DetectionService::DetectionService(const InferenceThreadConfig &config)
+    : running(true), cursor(0), queued(0), cpus(config.cpus) {
+  int n_threads = inference_threads_pool_size(config, 0);
+
+  omp_limit = inference_threads_openmp_share(config, n_threads);
+  omp_threads = inference_threads_openmp_max();
+  if (omp_threads > 0 && omp_limit > 0) {
+    omp_threads = omp_limit;
+  }
+
+  for (int i = 0; i < n_threads; i++) {
+    scratch.push_back((unsigned char *)malloc(DETECT_BUFFER_SIZE));
+  }
+  for (int i = 0; i < n_threads; i++) {
+    threads.emplace_back(&DetectionService::work, this, i);
+  }
+}
+
+DetectionService::~DetectionService() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    running = false;
+  }
+  job_cond.notify_all();
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (unsigned char *buffer : scratch) {
+    free(buffer);
+  }
+}
+
+void DetectionService::add_stream(SharedDetectionStream *stream) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  stream->credits = stream->priority;
+  streams.push_back(stream);
+}
+
+/* Drops the stream's queued frames and waits for the ones being detected,
+ * since their detect function may refer to the element. */
+void DetectionService::remove_stream(SharedDetectionStream *stream) {
+  std::unique_lock<std::mutex> guard(lock);
+
+  queued -= (guint)stream->pending.size();
+  stream->pending.clear();
+
+  idle_cond.wait(guard, [stream] { return stream->running == 0; });
+
+  streams.erase(std::remove(streams.begin(), streams.end(), stream),
+                streams.end());
+  if (cursor >= streams.size()) {
+    cursor = 0;
+  }
+}
+
+/* Queues @frame for @stream. Returns false when the frame was dropped
+ * because the stream's frames are all being detected or the service queue
+ * is full; the buffer is then kept for reuse. */
+bool DetectionService::enqueue(SharedDetectionStream *stream, cv::Mat &frame,
+                               GstClockTime pts,
+                               const DetectionParams &params) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (stream->pending.size() + stream->running >= stream->max_in_flight) {
+    if (stream->pending.empty()) {
+      stream->spare.push_back(frame);
+      return false;
+    }
+
+    stream->spare.push_back(stream->pending.front().frame);
+    stream->pending.pop_front();
+    queued--;
+  }
+
+  if (queued >= DETECTION_SERVICE_QUEUE_SIZE) {
+    stream->spare.push_back(frame);
+    return false;
+  }
+
+  stream->pending.push_back({frame, pts, params, stream->next_sequence++});
+  queued++;
+
+  return true;
+}
+
+/* Weighted round-robin: a stream keeps the cursor until it has used
+ * @priority turns, and all turns are handed out again once no stream with
+ * queued frames has any left. */
+SharedDetectionStream *DetectionService::pick_stream() {
+  for (int round = 0; round < 2 && !streams.empty(); round++) {
+    for (size_t i = 0; i < streams.size(); i++) {
+      size_t index = (cursor + i) % streams.size();
+      SharedDetectionStream *stream = streams[index];
+
+      if (stream->pending.empty() || stream->credits == 0) {
+        continue;
+      }
+
+      stream->credits--;
+      cursor = stream->credits > 0 ? index : (index + 1) % streams.size();
+      return stream;
+    }
+
+    bool has_work = false;
+    for (SharedDetectionStream *stream : streams) {
+      has_work = has_work || !stream->pending.empty();
+      stream->credits = stream->priority;
+    }
+    if (!has_work) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+void DetectionService::work(int index) {
+  std::vector<FacialData> faces;
+
+  inference_threads_pin(cpus);
+  inference_threads_limit_openmp(omp_limit);
+
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (true) {
+    SharedDetectionStream *stream = NULL;
+
+    job_cond.wait(guard, [this, &stream] {
+      return !running || (stream = pick_stream()) != NULL;
+    });
+    if (!running) {
+      break;
+    }
+
+    SharedDetectionStream::Job job = std::move(stream->pending.front());
+    stream->pending.pop_front();
+    queued--;
+    stream->running++;
+
+    guard.unlock();
+
+    faces.clear();
+    if (scratch[index]) {
+      stream->detect(scratch[index], job.frame, job.params, faces);
+    }
+
+    guard.lock();
+
+    stream->running--;
+
+    if (job.sequence > stream->result_sequence) {
+      stream->result.swap(faces);
+      stream->result_pts = job.pts;
+      stream->result_sequence = job.sequence;
+      stream->result_generation++;
+    }
+    stream->spare.push_back(job.frame);
+
+    if (stream->running == 0) {
+      idle_cond.notify_all();
+    }
+  }
+}
+
+SharedDetectionStream::SharedDetectionStream(
+    DetectFunc detect, guint priority, guint max_in_flight,
+    const InferenceThreadConfig &threads)
+    : detect(std::move(detect)), priority(std::max(priority, 1u)),
+      max_in_flight(std::max(max_in_flight, 1u)), running(0), credits(0),
+      next_sequence(1), result_pts(GST_CLOCK_TIME_NONE), result_sequence(0),
+      result_generation(0) {
+  service = DetectionService::acquire(threads);
+  service->add_stream(this);
+}
+
+SharedDetectionStream::~SharedDetectionStream() {
+  service->remove_stream(this);
+  DetectionService::release();
+}
+
+int SharedDetectionStream::n_threads() const {
+  return (int)service->threads.size();
+}
+
+int SharedDetectionStream::openmp_threads() const {
+  return service->omp_threads;
+}
+
+void SharedDetectionStream::submit(const cv::Mat &frame, GstClockTime pts,
+                                   const DetectionParams &params) {
+  cv::Mat buffer;
+
+  {
+    std::lock_guard<std::mutex> guard(service->lock);
+    if (!spare.empty()) {
+      buffer = spare.back();
+      spare.pop_back();
+    }
+  }
+
+  /* copy outside the service lock so other streams are not held up */
+  frame.copyTo(buffer);
+
+  if (service->enqueue(this, buffer, pts, params)) {
+    service->job_cond.notify_one();
+  }
+}
+
+bool SharedDetectionStream::fetch_latest(std::vector<FacialData> &faces,
+                                         GstClockTime &pts,
+                                         guint64 &generation) {
+  std::lock_guard<std::mutex> guard(service->lock);
+
+  if (result_generation == generation) {
+    return false;
+  }
+
+  faces.assign(result.begin(), result.end());
+  pts = result_pts;
+  generation = result_generation;
+  return true;
+}
@@ -0,0 +1,112 @@
+#ifndef __DETECTION_SERVICE_H__
+#define __DETECTION_SERVICE_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "detectionworker.hpp"
+
+class DetectionService;
+
+/* One element's connection to the shared DetectionService.
+ *
+ * Up to @max_in_flight frames of a stream are queued or being detected at a
+ * time; submitting beyond that replaces the oldest queued frame. Results may
+ * finish out of order, only ones newer than the current result are kept. */
+class SharedDetectionStream : public AsyncDetector {
+public:
+  SharedDetectionStream(DetectFunc detect, guint priority,
+                        guint max_in_flight,
+                        const InferenceThreadConfig &threads);
+  ~SharedDetectionStream() override;
+
+  SharedDetectionStream(const SharedDetectionStream &) = delete;
+  SharedDetectionStream &operator=(const SharedDetectionStream &) = delete;
+
+  void submit(const cv::Mat &frame, GstClockTime pts,
+              const DetectionParams &params) override;
+  bool fetch_latest(std::vector<FacialData> &faces, GstClockTime &pts,
+                    guint64 &generation) override;
+
+  int n_threads() const override;
+  int openmp_threads() const override;
+
+private:
+  friend class DetectionService;
+
+  typedef struct {
+    cv::Mat frame;
+    GstClockTime pts;
+    DetectionParams params;
+    guint64 sequence;
+  } Job;
+
+  DetectionService *service;
+  DetectFunc detect;
+  guint priority;
+  guint max_in_flight;
+
+  /* everything below is protected by the service lock */
+  std::deque<Job> pending;
+  std::vector<cv::Mat> spare;
+  guint running;
+  guint credits;
+  guint64 next_sequence;
+
+  std::vector<FacialData> result;
+  GstClockTime result_pts;
+  guint64 result_sequence;
+  guint64 result_generation;
+};
+
+/* A process-wide face detection engine shared by all element instances.
+ *
+ * A fixed pool of worker threads, each with its own scratch buffer, serves
+ * a bounded queue of frames from every registered stream. Streams are picked
+ * in weighted round-robin order: each gets as many turns per round as its
+ * priority, so one busy camera cannot starve the others. The service starts
+ * with its first stream and stops when the last one is gone.
+ *
+ * The thread count, CPU affinity and OpenMP share come from the thread
+ * config of the stream that started the service; later streams share it as
+ * it is. */
+class DetectionService {
+public:
+  static DetectionService *acquire(const InferenceThreadConfig &config);
+  static void release();
+
+private:
+  friend class SharedDetectionStream;
+
+  explicit DetectionService(const InferenceThreadConfig &config);
+  ~DetectionService();
+
+  void add_stream(SharedDetectionStream *stream);
+  void remove_stream(SharedDetectionStream *stream);
+  bool enqueue(SharedDetectionStream *stream, cv::Mat &frame,
+               GstClockTime pts, const DetectionParams &params);
+
+  SharedDetectionStream *pick_stream();
+  void work(int index);
+
+  std::mutex lock;
+  std::condition_variable job_cond;
+  std::condition_variable idle_cond;
+  bool running;
+
+  std::vector<SharedDetectionStream *> streams;
+  size_t cursor;
+  guint queued;
+
+  std::vector<unsigned char *> scratch;
+  std::vector<std::thread> threads;
+
+  std::vector<int> cpus;
+  int omp_limit;
+  int omp_threads;
+};
+
+#endif /* __DETECTION_SERVICE_H__ */
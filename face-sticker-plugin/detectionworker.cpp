@@ -0,0 +1,91 @@
+#include <stdlib.h>
+
+#include "detectionworker.hpp"
+#include "gstfacesticker.hpp"
+
+DetectionWorker::DetectionWorker(DetectFunc detect,
+                                 const InferenceThreadConfig &threads)
+    : detect(std::move(detect)), cpus(threads.cpus),
+      omp_limit(inference_threads_openmp_share(threads, 1)), running(true),
+      pending_pts(GST_CLOCK_TIME_NONE), has_pending(false),
+      result_pts(GST_CLOCK_TIME_NONE), result_generation(0) {
+  omp_threads = inference_threads_openmp_max();
+  if (omp_threads > 0 && omp_limit > 0) {
+    omp_threads = omp_limit;
+  }
+  scratch = (unsigned char *)malloc(DETECT_BUFFER_SIZE);
+  thread = std::thread(&DetectionWorker::run, this);
+}
+
+DetectionWorker::~DetectionWorker() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    running = false;
+  }
+  cond.notify_one();
+  thread.join();
+
+  free(scratch);
+}
+
+void DetectionWorker::submit(const cv::Mat &frame, GstClockTime pts,
+                             const DetectionParams &params) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    frame.copyTo(pending);
+    pending_pts = pts;
+    pending_params = params;
+    has_pending = true;
+  }
+  cond.notify_one();
+}
+
+bool DetectionWorker::fetch_latest(std::vector<FacialData> &faces,
+                                   GstClockTime &pts, guint64 &generation) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (result_generation == generation) {
+    return false;
+  }
+
+  faces.assign(result.begin(), result.end());
+  pts = result_pts;
+  generation = result_generation;
+  return true;
+}
+
+void DetectionWorker::run() {
+  std::vector<FacialData> faces;
+
+  inference_threads_pin(cpus);
+  inference_threads_limit_openmp(omp_limit);
+
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (true) {
+    cond.wait(guard, [this] { return has_pending || !running; });
+    if (!running) {
+      break;
+    }
+
+    /* Take the pending frame and leave the old working buffer in its place,
+     * so that steady-state submissions reuse both allocations. */
+    cv::swap(pending, working);
+    GstClockTime pts = pending_pts;
+    DetectionParams params = pending_params;
+    has_pending = false;
+
+    guard.unlock();
+
+    faces.clear();
+    if (scratch) {
+      detect(scratch, working, params, faces);
+    }
+
+    guard.lock();
+
+    result.swap(faces);
+    result_pts = pts;
+    result_generation++;
+  }
+}
@@ -0,0 +1,104 @@
+#ifndef __DETECTION_WORKER_H__
+#define __DETECTION_WORKER_H__
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gst/gst.h>
+#include <opencv2/core/mat.hpp>
+
+#include "facialdata.hpp"
+#include "inferencethreads.hpp"
+
+/* The element state a detection needs, copied when the frame is submitted
+ * so that detecting threads never read properties or caps being changed on
+ * other threads. */
+typedef struct {
+  /* size of the video frame the faces are mapped back to */
+  cv::Size frame_size;
+  guint tile_size;
+  guint tile_overlap;
+  /* run tiles one after the other on the calling thread instead of the
+   * element's detection pool, for callers that are already one of a pool */
+  gboolean inline_tiles;
+} DetectionParams;
+
+typedef std::function<void(unsigned char *scratch, const cv::Mat &frame,
+                           const DetectionParams &params,
+                           std::vector<FacialData> &faces)>
+    DetectFunc;
+
+/* Detection running off the streaming thread.
+ *
+ * The streaming thread hands frames over with submit() and picks up the
+ * newest finished result with fetch_latest(); neither call waits for the
+ * detector. */
+class AsyncDetector {
+public:
+  virtual ~AsyncDetector() {}
+
+  virtual void submit(const cv::Mat &frame, GstClockTime pts,
+                      const DetectionParams &params) = 0;
+
+  /* Copies the newest result into @faces if it is newer than @generation.
+   * Returns true when @faces, @pts and @generation were updated. */
+  virtual bool fetch_latest(std::vector<FacialData> &faces, GstClockTime &pts,
+                            guint64 &generation) = 0;
+
+  /* Returns how many threads run detection, and how many OpenMP threads
+   * each of them may use (0 without an OpenMP runtime). */
+  virtual int n_threads() const = 0;
+  virtual int openmp_threads() const = 0;
+};
+
+/* Runs face detection on a dedicated thread, pinned and given its OpenMP
+ * share as @threads says. Only one frame is kept pending: submitting while
+ * the worker is busy replaces the frame that has not been picked up yet. */
+class DetectionWorker : public AsyncDetector {
+public:
+  DetectionWorker(DetectFunc detect, const InferenceThreadConfig &threads);
+  ~DetectionWorker() override;
+
+  DetectionWorker(const DetectionWorker &) = delete;
+  DetectionWorker &operator=(const DetectionWorker &) = delete;
+
+  void submit(const cv::Mat &frame, GstClockTime pts,
+              const DetectionParams &params) override;
+  bool fetch_latest(std::vector<FacialData> &faces, GstClockTime &pts,
+                    guint64 &generation) override;
+
+  int n_threads() const override { return 1; }
+  int openmp_threads() const override { return omp_threads; }
+
+private:
+  void run();
+
+  DetectFunc detect;
+  unsigned char *scratch;
+
+  std::vector<int> cpus;
+  int omp_limit;
+  int omp_threads;
+
+  std::mutex lock;
+  std::condition_variable cond;
+  bool running;
+
+  cv::Mat pending;
+  GstClockTime pending_pts;
+  DetectionParams pending_params;
+  bool has_pending;
+
+  cv::Mat working;
+
+  std::vector<FacialData> result;
+  GstClockTime result_pts;
+  guint64 result_generation;
+
+  std::thread thread;
+};
+
+#endif /* __DETECTION_WORKER_H__ */
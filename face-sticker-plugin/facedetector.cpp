@@ -0,0 +1,219 @@
+#include <algorithm>
+
+#include <gst/gst.h>
+#include <opencv2/imgproc.hpp>
+
+#include "facedetectcnn.h"
+#include "facedetector.hpp"
+
+// Scores below this are dropped by YuNet itself, min_confidence applies on
+// top of it
+#define YUNET_SCORE_THRESHOLD 0.3f
+#define YUNET_NMS_THRESHOLD 0.3f
+#define YUNET_TOP_K 5000
+
+#define CASCADE_SCALE_FACTOR 1.1
+#define CASCADE_MIN_NEIGHBORS 3
+#define CASCADE_MIN_SIZE 24
+
+static FacialData extract_facial_data(const short *facial_landmarks) {
+  FacialData face;
+
+  face.confidence = facial_landmarks[0];
+  face.x = facial_landmarks[1];
+  face.y = facial_landmarks[2];
+  face.width = facial_landmarks[3];
+  face.height = facial_landmarks[4];
+
+  face.leftEye = cv::Point(facial_landmarks[5], facial_landmarks[6]);
+  face.rightEye = cv::Point(facial_landmarks[7], facial_landmarks[8]);
+  face.nose = cv::Point(facial_landmarks[9], facial_landmarks[10]);
+  face.leftMouth = cv::Point(facial_landmarks[11], facial_landmarks[12]);
+  face.rightMouth = cv::Point(facial_landmarks[13], facial_landmarks[14]);
+
+  return face;
+}
+
+void CnnFaceDetector::detect(unsigned char *scratch, const cv::Mat &image,
+                             std::vector<FacialData> &faces) {
+  int *p_results = facedetect_cnn(scratch, (unsigned char *)(image.ptr(0)),
+                                  image.cols, image.rows, (int)image.step);
+
+  int num_faces = p_results ? *p_results : 0;
+
+  for (int i = 0; i < num_faces; i++) {
+    const short *facial_landmarks = ((short *)(p_results + 1)) + 16 * i;
+    faces.push_back(extract_facial_data(facial_landmarks));
+  }
+}
+
+bool YuNetFaceDetector::load(const char *path, std::string &error) {
+  if (!path || !*path) {
+    error = "the yunet detector needs detector_model set to its ONNX model";
+    return false;
+  }
+
+  try {
+    cv::Ptr<cv::FaceDetectorYN> net = cv::FaceDetectorYN::create(
+        path, "", cv::Size(320, 320), YUNET_SCORE_THRESHOLD,
+        YUNET_NMS_THRESHOLD, YUNET_TOP_K);
+    if (!net) {
+      error = std::string("could not load ") + path;
+      return false;
+    }
+    idle.push_back(net);
+  } catch (const cv::Exception &e) {
+    error = e.what();
+    return false;
+  }
+
+  model_path = path;
+  return true;
+}
+
+void YuNetFaceDetector::detect(unsigned char * /* scratch */,
+                               const cv::Mat &image,
+                               std::vector<FacialData> &faces) {
+  cv::Ptr<cv::FaceDetectorYN> net;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!idle.empty()) {
+      net = idle.back();
+      idle.pop_back();
+    }
+  }
+  if (!net) {
+    /* the model loaded once already, but may have gone since */
+    try {
+      net = cv::FaceDetectorYN::create(model_path, "", image.size(),
+                                       YUNET_SCORE_THRESHOLD,
+                                       YUNET_NMS_THRESHOLD, YUNET_TOP_K);
+    } catch (const cv::Exception &e) {
+      GST_WARNING("could not create a YuNet detector from %s: %s",
+                  model_path.c_str(), e.what());
+    }
+    if (!net) {
+      return;
+    }
+  }
+
+  /* one row per face: box, right eye, left eye, nose tip, right and left
+   * mouth corner, score. The first eye and mouth corner are the ones on the
+   * image's left, like in facedetect_cnn's output. */
+  cv::Mat results;
+  try {
+    net->setInputSize(image.size());
+    net->detect(image, results);
+  } catch (const cv::Exception &e) {
+    /* no faces this time; the instance still goes back to the pool */
+    GST_WARNING("YuNet detection failed: %s", e.what());
+    results.release();
+  }
+
+  for (int i = 0; i < results.rows; i++) {
+    const float *row = results.ptr<float>(i);
+    FacialData face;
+
+    face.x = cvRound(row[0]);
+    face.y = cvRound(row[1]);
+    face.width = cvRound(row[2]);
+    face.height = cvRound(row[3]);
+    face.leftEye = cv::Point(cvRound(row[4]), cvRound(row[5]));
+    face.rightEye = cv::Point(cvRound(row[6]), cvRound(row[7]));
+    face.nose = cv::Point(cvRound(row[8]), cvRound(row[9]));
+    face.leftMouth = cv::Point(cvRound(row[10]), cvRound(row[11]));
+    face.rightMouth = cv::Point(cvRound(row[12]), cvRound(row[13]));
+    face.confidence = cvRound(row[14] * 100);
+
+    faces.push_back(face);
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  idle.push_back(net);
+}
+
+bool CascadeFaceDetector::load(const char *path, std::string &error) {
+  if (!path || !*path) {
+    error = "the cascade detector needs detector_model set to a cascade XML";
+    return false;
+  }
+
+  cv::Ptr<cv::CascadeClassifier> cascade = cv::makePtr<cv::CascadeClassifier>();
+  if (!cascade->load(path)) {
+    error = std::string("could not load ") + path;
+    return false;
+  }
+  idle.push_back(cascade);
+
+  model_path = path;
+  return true;
+}
+
+void CascadeFaceDetector::detect(unsigned char * /* scratch */,
+                                 const cv::Mat &image,
+                                 std::vector<FacialData> &faces) {
+  cv::Ptr<cv::CascadeClassifier> cascade;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!idle.empty()) {
+      cascade = idle.back();
+      idle.pop_back();
+    }
+  }
+  if (!cascade) {
+    try {
+      cascade = cv::makePtr<cv::CascadeClassifier>(model_path);
+    } catch (const cv::Exception &e) {
+      GST_WARNING("could not create a cascade classifier from %s: %s",
+                  model_path.c_str(), e.what());
+    }
+    if (!cascade || cascade->empty()) {
+      return;
+    }
+  }
+
+  cv::Mat gray;
+  std::vector<cv::Rect> boxes;
+  std::vector<int> neighbors;
+
+  try {
+    cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    cv::equalizeHist(gray, gray);
+    cascade->detectMultiScale(gray, boxes, neighbors, CASCADE_SCALE_FACTOR,
+                              CASCADE_MIN_NEIGHBORS, 0,
+                              cv::Size(CASCADE_MIN_SIZE, CASCADE_MIN_SIZE));
+  } catch (const cv::Exception &e) {
+    /* no faces this time; the instance still goes back to the pool */
+    GST_WARNING("cascade detection failed: %s", e.what());
+    boxes.clear();
+    neighbors.clear();
+  }
+
+  for (size_t i = 0; i < boxes.size(); i++) {
+    const cv::Rect &box = boxes[i];
+    FacialData face;
+
+    face.confidence = std::min(100, 20 * neighbors[i]);
+    face.x = box.x;
+    face.y = box.y;
+    face.width = box.width;
+    face.height = box.height;
+
+    auto at = [&box](double x, double y) {
+      return cv::Point(box.x + cvRound(box.width * x),
+                       box.y + cvRound(box.height * y));
+    };
+    face.leftEye = at(0.3, 0.38);
+    face.rightEye = at(0.7, 0.38);
+    face.nose = at(0.5, 0.58);
+    face.leftMouth = at(0.35, 0.78);
+    face.rightMouth = at(0.65, 0.78);
+
+    faces.push_back(face);
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  idle.push_back(cascade);
+}
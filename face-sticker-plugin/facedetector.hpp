@@ -0,0 +1,68 @@
+#ifndef __FACE_DETECTOR_H__
+#define __FACE_DETECTOR_H__
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/objdetect.hpp>
+
+#include "facialdata.hpp"
+
+/* A face detection backend.
+ *
+ * detect() appends the faces found on a BGR image to @faces, in image
+ * coordinates, with the confidence scaled to 0-100. @scratch is a
+ * DETECT_BUFFER_SIZE buffer owned by the calling thread; several threads
+ * may call detect() at once, each with its own scratch buffer. */
+class FaceDetector {
+public:
+  virtual ~FaceDetector() {}
+
+  virtual void detect(unsigned char *scratch, const cv::Mat &image,
+                      std::vector<FacialData> &faces) = 0;
+};
+
+/* libfacedetection's facedetect_cnn. */
+class CnnFaceDetector : public FaceDetector {
+public:
+  void detect(unsigned char *scratch, const cv::Mat &image,
+              std::vector<FacialData> &faces) override;
+};
+
+/* OpenCV's DNN-based YuNet (cv::FaceDetectorYN) on the CPU, loaded from an
+ * ONNX model. Instances are not thread-safe, so one is kept per concurrent
+ * caller. */
+class YuNetFaceDetector : public FaceDetector {
+public:
+  /* Loads the model at @model_path. Returns false and fills @error when it
+   * cannot be loaded. */
+  bool load(const char *model_path, std::string &error);
+
+  void detect(unsigned char *scratch, const cv::Mat &image,
+              std::vector<FacialData> &faces) override;
+
+private:
+  std::string model_path;
+  std::mutex lock;
+  std::vector<cv::Ptr<cv::FaceDetectorYN>> idle;
+};
+
+/* OpenCV Haar/LBP cascade: the fastest and least accurate backend. It finds
+ * boxes only, so the landmarks are placed at their typical positions within
+ * the box, and the confidence is 20 per neighbouring hit, capped at 100. */
+class CascadeFaceDetector : public FaceDetector {
+public:
+  bool load(const char *model_path, std::string &error);
+
+  void detect(unsigned char *scratch, const cv::Mat &image,
+              std::vector<FacialData> &faces) override;
+
+private:
+  std::string model_path;
+  std::mutex lock;
+  std::vector<cv::Ptr<cv::CascadeClassifier>> idle;
+};
+
+#endif /* __FACE_DETECTOR_H__ */
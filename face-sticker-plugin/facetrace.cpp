@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <string.h>
+
+#include "facetrace.hpp"
+
+#define FACE_TRACE_MAGIC_SIZE 8
+
+typedef struct {
+  guint64 pts;
+  guint32 n_faces;
+  guint32 reserved;
+} RecordHeader;
+
+static void pack_face(const FacialData &face, gint32 *values) {
+  const cv::Point *points[] = {&face.leftEye, &face.rightEye, &face.nose,
+                               &face.leftMouth, &face.rightMouth};
+
+  values[0] = face.confidence;
+  values[1] = face.x;
+  values[2] = face.y;
+  values[3] = face.width;
+  values[4] = face.height;
+  for (int i = 0; i < 5; i++) {
+    values[5 + 2 * i] = points[i]->x;
+    values[6 + 2 * i] = points[i]->y;
+  }
+}
+
+static FacialData unpack_face(const gint32 *values) {
+  FacialData face;
+  cv::Point *points[] = {&face.leftEye, &face.rightEye, &face.nose,
+                         &face.leftMouth, &face.rightMouth};
+
+  face.confidence = values[0];
+  face.x = values[1];
+  face.y = values[2];
+  face.width = values[3];
+  face.height = values[4];
+  for (int i = 0; i < 5; i++) {
+    *points[i] = cv::Point(values[5 + 2 * i], values[6 + 2 * i]);
+  }
+
+  return face;
+}
+
+gsize face_trace_record_size(gsize n_faces) {
+  return sizeof(RecordHeader) + n_faces * FACE_TRACE_FIELDS * sizeof(gint32);
+}
+
+void face_trace_pack_record(GstClockTime pts,
+                            const std::vector<FacialData> &faces,
+                            guint8 *data) {
+  RecordHeader header = {pts, (guint32)faces.size(), 0};
+  gint32 values[FACE_TRACE_FIELDS];
+
+  memcpy(data, &header, sizeof(header));
+  data += sizeof(header);
+  for (const FacialData &face : faces) {
+    pack_face(face, values);
+    memcpy(data, values, sizeof(values));
+    data += sizeof(values);
+  }
+}
+
+void face_trace_format_json(GstClockTime pts,
+                            const std::vector<FacialData> &faces,
+                            GString *json) {
+  gint32 values[FACE_TRACE_FIELDS];
+
+  if (GST_CLOCK_TIME_IS_VALID(pts)) {
+    g_string_append_printf(json, "{\"pts\":%" G_GUINT64_FORMAT ",\"faces\":[",
+                           (guint64)pts);
+  } else {
+    g_string_append(json, "{\"pts\":null,\"faces\":[");
+  }
+
+  for (size_t i = 0; i < faces.size(); i++) {
+    pack_face(faces[i], values);
+    g_string_append_printf(json,
+                           "%s{\"confidence\":%d,\"box\":[%d,%d,%d,%d],"
+                           "\"landmarks\":[",
+                           i ? "," : "", values[0], values[1], values[2],
+                           values[3], values[4]);
+    for (int k = 0; k < 5; k++) {
+      g_string_append_printf(json, "%s[%d,%d]", k ? "," : "",
+                             values[5 + 2 * k], values[6 + 2 * k]);
+    }
+    g_string_append(json, "]}");
+  }
+
+  g_string_append(json, "]}\n");
+}
+
+FaceTraceWriter::FaceTraceWriter() : file(NULL) {}
+
+FaceTraceWriter::~FaceTraceWriter() { close(); }
+
+bool FaceTraceWriter::open(const char *path) {
+  close();
+
+  /* a new recording replaces the old one, whose records for the same PTS
+   * would otherwise be found first on replay */
+  file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+
+  if (fwrite(FACE_TRACE_MAGIC, 1, FACE_TRACE_MAGIC_SIZE, file) !=
+      FACE_TRACE_MAGIC_SIZE) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void FaceTraceWriter::close() {
+  if (file) {
+    fclose(file);
+    file = NULL;
+  }
+}
+
+bool FaceTraceWriter::write(GstClockTime pts,
+                            const std::vector<FacialData> &faces) {
+  if (!file) {
+    return false;
+  }
+
+  record.resize(face_trace_record_size(faces.size()));
+  face_trace_pack_record(pts, faces, record.data());
+
+  return fwrite(record.data(), 1, record.size(), file) == record.size();
+}
+
+FaceTraceReader::FaceTraceReader() : mapped(NULL) {}
+
+FaceTraceReader::~FaceTraceReader() { close(); }
+
+bool FaceTraceReader::open(const char *path, GError **error) {
+  close();
+
+  mapped = g_mapped_file_new(path, FALSE, error);
+  if (!mapped) {
+    return false;
+  }
+
+  const char *data = g_mapped_file_get_contents(mapped);
+  gsize length = g_mapped_file_get_length(mapped);
+
+  if (length < FACE_TRACE_MAGIC_SIZE ||
+      memcmp(data, FACE_TRACE_MAGIC, FACE_TRACE_MAGIC_SIZE) != 0) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "%s is not a face trace", path);
+    close();
+    return false;
+  }
+
+  gsize offset = FACE_TRACE_MAGIC_SIZE;
+  while (offset + sizeof(RecordHeader) <= length) {
+    /* records are only 4 byte aligned, so the PTS is copied out */
+    RecordHeader header;
+    memcpy(&header, data + offset, sizeof(header));
+
+    gsize size = (gsize)header.n_faces * FACE_TRACE_FIELDS * sizeof(gint32);
+    if (size > length - offset - sizeof(header)) {
+      break;
+    }
+
+    records.push_back({header.pts, header.n_faces,
+                       (const gint32 *)(data + offset + sizeof(header))});
+    offset += sizeof(header) + size;
+  }
+
+  /* sort by PTS for lookup, keeping the recording order among equal ones */
+  by_pts.resize(records.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    by_pts[i] = i;
+  }
+  std::stable_sort(by_pts.begin(), by_pts.end(), [this](size_t a, size_t b) {
+    return records[a].pts < records[b].pts;
+  });
+
+  return true;
+}
+
+void FaceTraceReader::close() {
+  records.clear();
+  by_pts.clear();
+
+  if (mapped) {
+    g_mapped_file_unref(mapped);
+    mapped = NULL;
+  }
+}
+
+bool FaceTraceReader::lookup(GstClockTime pts, guint64 index,
+                             std::vector<FacialData> &faces) {
+  const Record *record = NULL;
+
+  if (GST_CLOCK_TIME_IS_VALID(pts)) {
+    auto it = std::lower_bound(
+        by_pts.begin(), by_pts.end(), pts,
+        [this](size_t i, GstClockTime value) { return records[i].pts < value; });
+    if (it != by_pts.end() && records[*it].pts == pts) {
+      record = &records[*it];
+    }
+  } else if (index < records.size()) {
+    record = &records[index];
+  }
+
+  faces.clear();
+  if (!record) {
+    return false;
+  }
+
+  for (guint32 i = 0; i < record->n_faces; i++) {
+    faces.push_back(unpack_face(record->values + i * FACE_TRACE_FIELDS));
+  }
+
+  return true;
+}
@@ -0,0 +1,94 @@
+#ifndef __FACE_TRACE_H__
+#define __FACE_TRACE_H__
+
+#include <stdio.h>
+#include <vector>
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "facialdata.hpp"
+
+/* Face detection traces: every frame's faces keyed by PTS, in an
+ * append-only binary file.
+ *
+ * The file starts with the 8 byte FACE_TRACE_MAGIC, followed by one record
+ * per frame: a 16 byte header (guint64 PTS, guint32 face count, guint32
+ * reserved) and then FACE_TRACE_FIELDS gint32 values per face: confidence,
+ * x, y, width, height and the x/y of the five landmarks. All values are in
+ * host byte order. */
+#define FACE_TRACE_MAGIC "FSTRACE1"
+#define FACE_TRACE_FIELDS 15
+
+/* Size in bytes of the record of @n_faces faces. */
+gsize face_trace_record_size(gsize n_faces);
+
+/* Packs the record of @faces at @pts into @data, which must hold
+ * face_trace_record_size() bytes. */
+void face_trace_pack_record(GstClockTime pts,
+                            const std::vector<FacialData> &faces,
+                            guint8 *data);
+
+/* Appends the same record to @json as one line of JSON:
+ *
+ *   {"pts":40000000,"faces":[{"confidence":92,"box":[x,y,width,height],
+ *    "landmarks":[[x,y],[x,y],[x,y],[x,y],[x,y]]}]}
+ *
+ * with the landmarks in the order left eye, right eye, nose, left and right
+ * mouth corner. An invalid @pts is written as null. */
+void face_trace_format_json(GstClockTime pts,
+                            const std::vector<FacialData> &faces,
+                            GString *json);
+
+class FaceTraceWriter {
+public:
+  FaceTraceWriter();
+  ~FaceTraceWriter();
+
+  FaceTraceWriter(const FaceTraceWriter &) = delete;
+  FaceTraceWriter &operator=(const FaceTraceWriter &) = delete;
+
+  /* Creates or truncates @path and writes the magic. Returns false when the
+   * file cannot be written. */
+  bool open(const char *path);
+  void close();
+
+  bool write(GstClockTime pts, const std::vector<FacialData> &faces);
+
+private:
+  FILE *file;
+  std::vector<guint8> record;
+};
+
+/* Memory-maps a trace and looks records up by PTS. */
+class FaceTraceReader {
+public:
+  FaceTraceReader();
+  ~FaceTraceReader();
+
+  FaceTraceReader(const FaceTraceReader &) = delete;
+  FaceTraceReader &operator=(const FaceTraceReader &) = delete;
+
+  /* Maps @path and indexes its records. A record cut short at the end of
+   * the file, as left by an interrupted recording, is ignored. */
+  bool open(const char *path, GError **error);
+  void close();
+
+  /* Copies the faces recorded for @pts into @faces. When @pts is not valid
+   * the @index'th record is used instead. Returns false when there is no
+   * such record. */
+  bool lookup(GstClockTime pts, guint64 index, std::vector<FacialData> &faces);
+
+private:
+  typedef struct {
+    GstClockTime pts;
+    guint32 n_faces;
+    const gint32 *values;
+  } Record;
+
+  GMappedFile *mapped;
+  std::vector<Record> records;
+  std::vector<size_t> by_pts;
+};
+
+#endif /* __FACE_TRACE_H__ */
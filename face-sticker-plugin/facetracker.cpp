@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include "facetracker.hpp"
+
+#define TRACKER_MIN_IOU 0.3f
+#define TRACKER_WINDOW_SIZE 21
+#define TRACKER_PYRAMID_LEVELS 3
+
+static float rect_iou(const cv::Rect2f &a, const cv::Rect2f &b) {
+  float intersection = (a & b).area();
+  float union_area = a.area() + b.area() - intersection;
+
+  return union_area > 0 ? intersection / union_area : 0;
+}
+
+static float median(float *values, int count) {
+  std::nth_element(values, values + count / 2, values + count);
+  return values[count / 2];
+}
+
+static float point_spread(const cv::Point2f *points, int count) {
+  cv::Point2f centroid(0, 0);
+  for (int i = 0; i < count; i++) {
+    centroid += points[i];
+  }
+  centroid *= 1.0f / count;
+
+  float spread = 0;
+  for (int i = 0; i < count; i++) {
+    spread += (float)cv::norm(points[i] - centroid);
+  }
+
+  return spread / count;
+}
+
+FaceTracker::FaceTracker() : next_id(0), scale_x(1), scale_y(1) {}
+
+void FaceTracker::reset() {
+  tracks.clear();
+  prev_gray.release();
+}
+
+void FaceTracker::update(const cv::Mat &image, const cv::Size &frame_size,
+                         const std::vector<FacialData> &detections) {
+  cv::cvtColor(image, prev_gray, cv::COLOR_BGR2GRAY);
+
+  scale_x = (float)image.cols / frame_size.width;
+  scale_y = (float)image.rows / frame_size.height;
+
+  spare_tracks.clear();
+  matched.assign(tracks.size(), false);
+
+  for (const FacialData &face : detections) {
+    Track track;
+
+    track.confidence = face.confidence;
+    track.box = cv::Rect2f(face.x * scale_x, face.y * scale_y,
+                           face.width * scale_x, face.height * scale_y);
+
+    const cv::Point *points[NUM_POINTS] = {&face.leftEye, &face.rightEye,
+                                           &face.nose, &face.leftMouth,
+                                           &face.rightMouth};
+    for (int i = 0; i < NUM_POINTS; i++) {
+      track.points[i] =
+          cv::Point2f(points[i]->x * scale_x, points[i]->y * scale_y);
+    }
+
+    int best = -1;
+    float best_iou = TRACKER_MIN_IOU;
+    for (size_t j = 0; j < tracks.size(); j++) {
+      float iou = rect_iou(track.box, tracks[j].box);
+      if (!matched[j] && iou >= best_iou) {
+        best = (int)j;
+        best_iou = iou;
+      }
+    }
+
+    if (best >= 0) {
+      matched[best] = true;
+      track.id = tracks[best].id;
+    } else {
+      track.id = next_id++;
+    }
+
+    spare_tracks.push_back(track);
+  }
+
+  tracks.swap(spare_tracks);
+}
+
+bool FaceTracker::track(const cv::Mat &image, const cv::Size &frame_size,
+                        std::vector<FacialData> &faces) {
+  if (prev_gray.empty() || prev_gray.size() != image.size() ||
+      std::abs(scale_x - (float)image.cols / frame_size.width) > 1e-6f) {
+    return false;
+  }
+
+  cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+
+  faces.clear();
+
+  if (tracks.empty()) {
+    cv::swap(prev_gray, gray);
+    return true;
+  }
+
+  prev_points.clear();
+  for (const Track &track : tracks) {
+    prev_points.insert(prev_points.end(), track.points,
+                       track.points + NUM_POINTS);
+  }
+
+  cv::calcOpticalFlowPyrLK(
+      prev_gray, gray, prev_points, next_points, status, error,
+      cv::Size(TRACKER_WINDOW_SIZE, TRACKER_WINDOW_SIZE),
+      TRACKER_PYRAMID_LEVELS);
+
+  size_t kept = 0;
+  for (size_t t = 0; t < tracks.size(); t++) {
+    Track &track = tracks[t];
+    const size_t base = t * NUM_POINTS;
+
+    float dx[NUM_POINTS];
+    float dy[NUM_POINTS];
+    cv::Point2f old_points[NUM_POINTS];
+    cv::Point2f new_points[NUM_POINTS];
+    int count = 0;
+
+    for (int i = 0; i < NUM_POINTS; i++) {
+      if (!status[base + i]) {
+        continue;
+      }
+      old_points[count] = prev_points[base + i];
+      new_points[count] = next_points[base + i];
+      dx[count] = new_points[count].x - old_points[count].x;
+      dy[count] = new_points[count].y - old_points[count].y;
+      count++;
+    }
+
+    /* a face that lost all of its landmarks is dropped until the next
+     * keyframe finds it again */
+    if (count == 0) {
+      continue;
+    }
+
+    cv::Point2f shift(median(dx, count), median(dy, count));
+
+    float scale = 1.0f;
+    if (count >= 2) {
+      float old_spread = point_spread(old_points, count);
+      if (old_spread > 0) {
+        scale = point_spread(new_points, count) / old_spread;
+      }
+    }
+
+    cv::Point2f center(track.box.x + track.box.width / 2 + shift.x,
+                       track.box.y + track.box.height / 2 + shift.y);
+    float width = track.box.width * scale;
+    float height = track.box.height * scale;
+    track.box = cv::Rect2f(center.x - width / 2, center.y - height / 2, width,
+                           height);
+
+    for (int i = 0; i < NUM_POINTS; i++) {
+      track.points[i] =
+          status[base + i] ? next_points[base + i] : track.points[i] + shift;
+    }
+
+    tracks[kept++] = track;
+
+    FacialData face;
+    to_facial_data(track, face);
+    faces.push_back(face);
+  }
+  tracks.resize(kept);
+
+  cv::swap(prev_gray, gray);
+
+  return true;
+}
+
+void FaceTracker::to_facial_data(const Track &track, FacialData &face) const {
+  face.confidence = track.confidence;
+  face.x = cvRound(track.box.x / scale_x);
+  face.y = cvRound(track.box.y / scale_y);
+  face.width = cvRound(track.box.width / scale_x);
+  face.height = cvRound(track.box.height / scale_y);
+
+  cv::Point *points[NUM_POINTS] = {&face.leftEye, &face.rightEye, &face.nose,
+                                   &face.leftMouth, &face.rightMouth};
+  for (int i = 0; i < NUM_POINTS; i++) {
+    *points[i] = cv::Point(cvRound(track.points[i].x / scale_x),
+                           cvRound(track.points[i].y / scale_y));
+  }
+}
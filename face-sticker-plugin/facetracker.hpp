@@ -0,0 +1,64 @@
+#ifndef __FACE_TRACKER_H__
+#define __FACE_TRACKER_H__
+
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+#include "facialdata.hpp"
+
+/* Carries faces found on a keyframe through the following frames.
+ *
+ * Each face keeps its five landmarks, which are followed with pyramidal
+ * Lucas-Kanade optical flow on a grayscale copy of the detection image. The
+ * box is moved by the median landmark displacement and scaled with the
+ * landmark spread. At every keyframe the fresh detections are matched to the
+ * current tracks by IoU so that a face keeps its track id. */
+class FaceTracker {
+public:
+  FaceTracker();
+
+  /* Replaces the tracked faces with @detections, given in coordinates of a
+   * @frame_size frame, found on @image. */
+  void update(const cv::Mat &image, const cv::Size &frame_size,
+              const std::vector<FacialData> &detections);
+
+  /* Moves the tracked faces to @image and writes them to @faces in frame
+   * coordinates. Returns false when there is nothing to track from, in which
+   * case a keyframe is needed. */
+  bool track(const cv::Mat &image, const cv::Size &frame_size,
+             std::vector<FacialData> &faces);
+
+  void reset();
+
+private:
+  enum { NUM_POINTS = 5 };
+
+  struct Track {
+    int id;
+    int confidence;
+    cv::Rect2f box;
+    cv::Point2f points[NUM_POINTS];
+  };
+
+  void to_facial_data(const Track &track, FacialData &face) const;
+
+  std::vector<Track> tracks;
+  std::vector<Track> spare_tracks;
+  std::vector<bool> matched;
+  int next_id;
+
+  /* frame coordinates to tracking image coordinates */
+  float scale_x;
+  float scale_y;
+
+  cv::Mat prev_gray;
+  cv::Mat gray;
+
+  std::vector<cv::Point2f> prev_points;
+  std::vector<cv::Point2f> next_points;
+  std::vector<unsigned char> status;
+  std::vector<float> error;
+};
+
+#endif /* __FACE_TRACKER_H__ */
@@ -0,0 +1,19 @@
+#ifndef __FACIAL_DATA_H__
+#define __FACIAL_DATA_H__
+
+#include <opencv2/core/types.hpp>
+
+typedef struct {
+  int confidence;
+  int x;
+  int y;
+  int width;
+  int height;
+  cv::Point leftEye;
+  cv::Point rightEye;
+  cv::Point nose;
+  cv::Point leftMouth;
+  cv::Point rightMouth;
+} FacialData;
+
+#endif /* __FACIAL_DATA_H__ */
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <stdlib.h>
+
+#include "framequeue.hpp"
+#include "gstfacesticker.hpp"
+#include "inferencethreads.hpp"
+
+ParallelFrameQueue::ParallelFrameQueue(int n_threads, int window,
+                                       const std::vector<int> &cpus,
+                                       ProcessFunc process)
+    : process(std::move(process)), window((size_t)std::max(window, 1)),
+      cpus(cpus), running(true), n_queued(0), n_running(0) {
+  n_threads = std::max(n_threads, 1);
+
+  for (int i = 0; i < n_threads; i++) {
+    scratch.push_back((unsigned char *)malloc(DETECT_BUFFER_SIZE));
+  }
+  for (int i = 0; i < n_threads; i++) {
+    threads.emplace_back(&ParallelFrameQueue::work, this, i);
+  }
+}
+
+ParallelFrameQueue::~ParallelFrameQueue() {
+  flush();
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    running = false;
+  }
+  job_cond.notify_all();
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (unsigned char *buffer : scratch) {
+    free(buffer);
+  }
+}
+
+bool ParallelFrameQueue::empty() {
+  std::lock_guard<std::mutex> guard(lock);
+
+  return slots.empty();
+}
+
+void ParallelFrameQueue::submit(GstBuffer *buffer) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    slots.push_back({buffer, SLOT_QUEUED, GST_FLOW_OK});
+    n_queued++;
+  }
+  job_cond.notify_one();
+}
+
+GstBuffer *ParallelFrameQueue::pop(bool drain, GstFlowReturn &ret) {
+  std::unique_lock<std::mutex> guard(lock);
+
+  ret = GST_FLOW_OK;
+  if (slots.empty()) {
+    return NULL;
+  }
+
+  if (drain || slots.size() > window) {
+    done_cond.wait(guard, [this] { return slots.front().state == SLOT_DONE; });
+  } else if (slots.front().state != SLOT_DONE) {
+    return NULL;
+  }
+
+  GstBuffer *buffer = slots.front().buffer;
+  ret = slots.front().ret;
+  slots.pop_front();
+
+  return buffer;
+}
+
+void ParallelFrameQueue::flush() {
+  std::unique_lock<std::mutex> guard(lock);
+
+  /* queued frames are dropped right away, running ones once finished */
+  for (Slot &slot : slots) {
+    if (slot.state == SLOT_QUEUED) {
+      slot.state = SLOT_DONE;
+    }
+  }
+  n_queued = 0;
+
+  done_cond.wait(guard, [this] { return n_running == 0; });
+
+  for (Slot &slot : slots) {
+    gst_buffer_unref(slot.buffer);
+  }
+  slots.clear();
+}
+
+void ParallelFrameQueue::work(int index) {
+  inference_threads_pin(cpus);
+
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (true) {
+    job_cond.wait(guard, [this] { return !running || n_queued > 0; });
+    if (!running) {
+      break;
+    }
+
+    Slot *slot = NULL;
+    for (Slot &candidate : slots) {
+      if (candidate.state == SLOT_QUEUED) {
+        slot = &candidate;
+        break;
+      }
+    }
+
+    slot->state = SLOT_RUNNING;
+    n_queued--;
+    n_running++;
+
+    guard.unlock();
+    GstFlowReturn ret = scratch[index]
+                            ? process(index, scratch[index], slot->buffer)
+                            : GST_FLOW_ERROR;
+    guard.lock();
+
+    slot->ret = ret;
+    slot->state = SLOT_DONE;
+    n_running--;
+    done_cond.notify_all();
+  }
+}
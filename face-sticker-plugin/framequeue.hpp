@@ -0,0 +1,76 @@
+#ifndef __FRAME_QUEUE_H__
+#define __FRAME_QUEUE_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gst/gst.h>
+
+/* Processes whole frames on several threads at once and hands them back in
+ * the order they were submitted, for throughput-bound offline pipelines.
+ *
+ * Each thread owns a DETECT_BUFFER_SIZE scratch buffer and is pinned to
+ * @cpus unless it is empty. The @process function is called with the index
+ * of the thread running it, so that callers can keep per-thread state. */
+class ParallelFrameQueue {
+public:
+  typedef std::function<GstFlowReturn(int worker, unsigned char *scratch,
+                                      GstBuffer *buffer)>
+      ProcessFunc;
+
+  ParallelFrameQueue(int n_threads, int window, const std::vector<int> &cpus,
+                     ProcessFunc process);
+  ~ParallelFrameQueue();
+
+  ParallelFrameQueue(const ParallelFrameQueue &) = delete;
+  ParallelFrameQueue &operator=(const ParallelFrameQueue &) = delete;
+
+  int size() const { return (int)threads.size(); }
+  bool empty();
+
+  /* Takes ownership of @buffer and queues it for processing. */
+  void submit(GstBuffer *buffer);
+
+  /* Returns the oldest buffer once it is processed, with the result of its
+   * processing in @ret. Waits for it when @drain is set or the window is
+   * full, otherwise returns NULL while it is still being worked on. Returns
+   * NULL when nothing is queued. */
+  GstBuffer *pop(bool drain, GstFlowReturn &ret);
+
+  /* Drops every queued buffer, waiting for the ones being processed. */
+  void flush();
+
+private:
+  typedef enum { SLOT_QUEUED, SLOT_RUNNING, SLOT_DONE } SlotState;
+
+  typedef struct {
+    GstBuffer *buffer;
+    SlotState state;
+    GstFlowReturn ret;
+  } Slot;
+
+  void work(int index);
+
+  ProcessFunc process;
+  size_t window;
+  std::vector<int> cpus;
+
+  std::mutex lock;
+  std::condition_variable job_cond;
+  std::condition_variable done_cond;
+  bool running;
+
+  /* in submission order; slots stay in place while being processed */
+  std::deque<Slot> slots;
+  size_t n_queued;
+  size_t n_running;
+
+  std::vector<unsigned char *> scratch;
+  std::vector<std::thread> threads;
+};
+
+#endif /* __FRAME_QUEUE_H__ */
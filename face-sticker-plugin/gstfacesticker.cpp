@@ -41,14 +41,32 @@
 #include <gst/controller/controller.h>
 #include <gst/gst.h>
 #include <gst/video/video-frame.h>
+#include <gst/video/video.h>
+#include <new>
 #include <opencv2/opencv.hpp>
 
-#include "facedetectcnn.h"
+#include "anonymize.hpp"
+#include "detectionpool.hpp"
+#include "detectionservice.hpp"
+#include "detectionworker.hpp"
+#include "facedetector.hpp"
+#include "facetrace.hpp"
+#include "facetracker.hpp"
+#include "framequeue.hpp"
 #include "gstfacesticker.hpp"
+#include "scenechange.hpp"
+#include "stagestats.hpp"
+#include "stickerblend.hpp"
+#include "stickeratlas.hpp"
+#include "stickercache.hpp"
+#include "stickerconfig.hpp"
 
 GST_DEBUG_CATEGORY_STATIC(gst_face_sticker_debug);
 #define GST_CAT_DEFAULT gst_face_sticker_debug
 
+// Wrapped overlay pixel buffers kept before the whole set is dropped
+#define OVERLAY_PIXELS_MAX 64
+
 /* Filter signals and args */
 enum {
   /* FILL ME */
@@ -61,25 +79,179 @@ enum {
   PROP_EYEIMG_PATH,
   PROP_EYEIMG_SCALE,
   PROP_MIN_CONFIDENCE,
+  PROP_ASYNC_DETECTION,
+  PROP_DETECTION_INTERVAL,
+  PROP_MAX_RESULT_AGE,
+  PROP_DETECTION_WIDTH,
+  PROP_KEYFRAME_INTERVAL,
+  PROP_TILE_SIZE,
+  PROP_TILE_OVERLAP,
+  PROP_DETECTION_THREADS,
+  PROP_SHARED_DETECTION,
+  PROP_DETECTION_PRIORITY,
+  PROP_MAX_IN_FLIGHT,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_ADAPTIVE_QOS,
+  PROP_SCENE_THRESHOLD,
+  PROP_SCENE_MAX_REUSE,
+  PROP_FULL_SCAN_INTERVAL,
+  PROP_ROI_EXPANSION,
+  PROP_MODE,
+  PROP_OVERLAY_COMPOSITION,
+  PROP_TRACE_MODE,
+  PROP_TRACE_PATH,
+  PROP_DETECTOR,
+  PROP_DETECTOR_MODEL,
+  PROP_N_THREADS,
+  PROP_CPU_AFFINITY,
+  PROP_PARALLEL_FRAMES,
+  PROP_EFFECT,
+  PROP_STICKER_FPS,
+  PROP_SPRITE_COLUMNS,
+  PROP_SPRITE_ROWS,
+  PROP_ATLAS_PATH,
+  PROP_META_FORMAT,
 };
 
 /* the capabilities of the inputs and outputs.
  *
- * FIXME:describe the real formats here.
+ * BGR is processed directly. For I420 and NV12 only the detection proxy is
+ * converted to BGR; stickers are blended straight into the Y and UV planes.
  */
-static GstStaticPadTemplate sink_template =
-    GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
-                            GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("{ BGR }")));
-
-static GstStaticPadTemplate src_template =
-    GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS,
-                            GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("{ BGR }")));
+#define FACE_STICKER_FORMATS "{ BGR, I420, NV12 }"
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(FACE_STICKER_FORMATS)));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+    "src", GST_PAD_SRC, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(FACE_STICKER_FORMATS)));
+
+/* One buffer per video frame with the faces found in it, either a face
+ * trace record (see facetrace.hpp) or a line of JSON. */
+#define FACE_STICKER_META_CAPS "application/x-face-detections"
+
+static GstStaticPadTemplate meta_src_template = GST_STATIC_PAD_TEMPLATE(
+    "meta_src", GST_PAD_SRC, GST_PAD_REQUEST,
+    GST_STATIC_CAPS(FACE_STICKER_META_CAPS
+                    ", format = (string) { binary, json }"));
+
+/* qdata holding the detection record of a frame of the parallel queue until
+ * the frame is pushed */
+static GQuark meta_record_quark;
+
+/* A mapped video frame with each plane wrapped in a cv::Mat. Plane 0 is the
+ * BGR image or the luma plane; @x_shift and @y_shift give each plane's
+ * subsampling as a power of two. */
+typedef struct {
+  GstVideoFormat format;
+  int n_planes;
+  cv::Mat planes[GST_VIDEO_MAX_PLANES];
+  int x_shift[GST_VIDEO_MAX_PLANES];
+  int y_shift[GST_VIDEO_MAX_PLANES];
+} FramePlanes;
 
 #define gst_face_sticker_parent_class parent_class
 G_DEFINE_TYPE(GstFaceSticker, gst_face_sticker, GST_TYPE_BASE_TRANSFORM);
 GST_ELEMENT_REGISTER_DEFINE(face_sticker, "face_sticker", GST_RANK_NONE,
                             GST_TYPE_FACESTICKER);
 
+GType gst_face_sticker_mode_get_type(void) {
+  static GType mode_type = 0;
+  static const GEnumValue modes[] = {
+      {GST_FACE_STICKER_MODE_FULL, "Detect faces and draw on the frame",
+       "full"},
+      {GST_FACE_STICKER_MODE_DETECT,
+       "Detect faces and attach them as region of interest meta", "detect"},
+      {GST_FACE_STICKER_MODE_RENDER,
+       "Draw the faces found in region of interest meta", "render"},
+      {0, NULL, NULL},
+  };
+
+  if (g_once_init_enter(&mode_type)) {
+    GType type = g_enum_register_static("GstFaceStickerMode", modes);
+    g_once_init_leave(&mode_type, type);
+  }
+
+  return mode_type;
+}
+
+GType gst_face_sticker_trace_mode_get_type(void) {
+  static GType trace_mode_type = 0;
+  static const GEnumValue trace_modes[] = {
+      {GST_FACE_STICKER_TRACE_NONE, "No trace", "none"},
+      {GST_FACE_STICKER_TRACE_RECORD, "Append every frame's faces to the trace",
+       "record"},
+      {GST_FACE_STICKER_TRACE_REPLAY,
+       "Take the faces from the trace instead of detecting", "replay"},
+      {0, NULL, NULL},
+  };
+
+  if (g_once_init_enter(&trace_mode_type)) {
+    GType type =
+        g_enum_register_static("GstFaceStickerTraceMode", trace_modes);
+    g_once_init_leave(&trace_mode_type, type);
+  }
+
+  return trace_mode_type;
+}
+
+GType gst_face_sticker_detector_get_type(void) {
+  static GType detector_type = 0;
+  static const GEnumValue detectors[] = {
+      {GST_FACE_STICKER_DETECTOR_CNN, "libfacedetection CNN", "cnn"},
+      {GST_FACE_STICKER_DETECTOR_YUNET, "OpenCV YuNet (DNN, CPU)", "yunet"},
+      {GST_FACE_STICKER_DETECTOR_CASCADE, "OpenCV cascade classifier",
+       "cascade"},
+      {0, NULL, NULL},
+  };
+
+  if (g_once_init_enter(&detector_type)) {
+    GType type = g_enum_register_static("GstFaceStickerDetector", detectors);
+    g_once_init_leave(&detector_type, type);
+  }
+
+  return detector_type;
+}
+
+GType gst_face_sticker_effect_get_type(void) {
+  static GType effect_type = 0;
+  static const GEnumValue effects[] = {
+      {GST_FACE_STICKER_EFFECT_STICKER, "Eye stickers", "sticker"},
+      {GST_FACE_STICKER_EFFECT_PIXELATE, "Pixelate the whole face",
+       "pixelate"},
+      {GST_FACE_STICKER_EFFECT_BLUR, "Blur the whole face", "blur"},
+      {0, NULL, NULL},
+  };
+
+  if (g_once_init_enter(&effect_type)) {
+    GType type = g_enum_register_static("GstFaceStickerEffect", effects);
+    g_once_init_leave(&effect_type, type);
+  }
+
+  return effect_type;
+}
+
+GType gst_face_sticker_meta_format_get_type(void) {
+  static GType meta_format_type = 0;
+  static const GEnumValue meta_formats[] = {
+      {GST_FACE_STICKER_META_FORMAT_BINARY, "Face trace records", "binary"},
+      {GST_FACE_STICKER_META_FORMAT_JSON, "One line of JSON per frame",
+       "json"},
+      {0, NULL, NULL},
+  };
+
+  if (g_once_init_enter(&meta_format_type)) {
+    GType type =
+        g_enum_register_static("GstFaceStickerMetaFormat", meta_formats);
+    g_once_init_leave(&meta_format_type, type);
+  }
+
+  return meta_format_type;
+}
+
 static void gst_face_sticker_set_property(GObject *object, guint prop_id,
                                           const GValue *value,
                                           GParamSpec *pspec);
@@ -88,28 +260,170 @@ static void gst_face_sticker_get_property(GObject *object, guint prop_id,
 static void gst_face_sticker_finalize(GObject *object);
 static gboolean gst_face_sticker_set_caps(GstBaseTransform *trans,
                                           GstCaps *incaps, GstCaps *outcaps);
+static gboolean gst_face_sticker_propose_allocation(GstBaseTransform *trans,
+                                                   GstQuery *decide_query,
+                                                   GstQuery *query);
+static void get_frame_alignment(GstVideoAlignment *align);
+static gboolean gst_face_sticker_start(GstBaseTransform *trans);
+static gboolean gst_face_sticker_stop(GstBaseTransform *trans);
+static gboolean gst_face_sticker_src_event(GstBaseTransform *trans,
+                                           GstEvent *event);
+static gboolean gst_face_sticker_sink_event(GstBaseTransform *trans,
+                                            GstEvent *event);
+static GstPad *gst_face_sticker_request_new_pad(GstElement *element,
+                                                GstPadTemplate *templ,
+                                                const gchar *name,
+                                                const GstCaps *caps);
+static void gst_face_sticker_release_pad(GstElement *element, GstPad *pad);
+static GstFlowReturn
+gst_face_sticker_submit_input_buffer(GstBaseTransform *trans,
+                                     gboolean is_discont, GstBuffer *input);
+static GstFlowReturn gst_face_sticker_generate_output(GstBaseTransform *trans,
+                                                      GstBuffer **outbuf);
 static GstFlowReturn gst_face_sticker_transform_ip(GstBaseTransform *base,
                                                    GstBuffer *outbuf);
-static void process_face_detection(GstFaceSticker *filter, cv::Mat &frame_mat);
+static gboolean map_frame(GstFaceSticker *filter,
+                          const FaceStickerConfig &config, GstBuffer *buffer,
+                          GstVideoFrame *frame, FramePlanes &planes);
+static void check_overlay_support(GstFaceSticker *filter);
+static gboolean uses_overlay(GstFaceSticker *filter,
+                             const FaceStickerConfig &config);
+static void wrap_video_frame(GstVideoFrame *frame, FramePlanes &planes);
+static void create_frame_queue(GstFaceSticker *filter);
+static void destroy_frame_queue(GstFaceSticker *filter);
+static void drain_frame_queue(GstFaceSticker *filter);
+static GstFlowReturn process_parallel_frame(GstFaceSticker *filter,
+                                            int worker,
+                                            unsigned char *scratch,
+                                            GstBuffer *buffer);
+static void update_qos_level(GstFaceSticker *filter);
+static guint get_qos_interval(GstFaceSticker *filter, guint interval);
+static guint get_detection_width(GstFaceSticker *filter, int frame_width);
+static gboolean is_scene_unchanged(GstFaceSticker *filter,
+                                   const FramePlanes &frame);
+static void process_face_detection(GstFaceSticker *filter, FramePlanes &frame);
+static void track_faces(GstFaceSticker *filter, const cv::Mat &detection_mat,
+                        const cv::Size &frame_size, guint keyframe_interval);
+static gboolean process_async_face_detection(GstFaceSticker *filter,
+                                             FramePlanes &frame,
+                                             GstClockTime pts);
+static void attach_face_metas(GstFaceSticker *filter, GstBuffer *buffer,
+                              const std::vector<FacialData> &faces);
+static void read_face_metas(GstBuffer *buffer, std::vector<FacialData> &faces);
+static void attach_sticker_overlay(GstFaceSticker *filter,
+                                   const FaceStickerConfig &config,
+                                   GstBuffer *buffer,
+                                   const std::vector<FacialData> &faces);
+static gboolean get_sticker_loader(GstFaceSticker *filter);
+static void load_sticker(GstFaceSticker *filter);
+static void publish_sticker(GstFaceSticker *filter,
+                            std::shared_ptr<const StickerAsset> asset);
+static void load_atlas(GstFaceSticker *filter);
+static void publish_atlas(GstFaceSticker *filter, const std::string &path,
+                          std::shared_ptr<const StickerAtlas> atlas,
+                          const GError *error);
+static GstBuffer *get_overlay_pixels(GstFaceSticker *filter,
+                                     const cv::Mat &pixels);
+static void clear_overlay_pixels(GstFaceSticker *filter);
+static void add_overlay_rectangle(GstFaceSticker *filter,
+                                  GstVideoOverlayComposition **composition,
+                                  const StickerSprite &sprite,
+                                  const cv::Rect &roi);
+static gboolean open_trace(GstFaceSticker *filter);
+static gboolean create_face_detector(GstFaceSticker *filter);
+static gboolean configure_threads(GstFaceSticker *filter);
+static void report_threads(GstFaceSticker *filter, int concurrency);
+static unsigned char *get_streaming_scratch(GstFaceSticker *filter);
+static DetectionPool *get_detection_pool(GstFaceSticker *filter);
+static void run_pooled_detector(GstFaceSticker *filter,
+                                const cv::Mat &detection_mat,
+                                std::vector<FacialData> &faces);
+static const cv::Mat &prepare_detection_frame(GstFaceSticker *filter,
+                                              const FramePlanes &frame,
+                                              cv::Mat &detection_mat,
+                                              cv::Mat &detection_yuv);
+static const cv::Mat &prepare_yuv_detection_frame(GstFaceSticker *filter,
+                                                  const FramePlanes &frame,
+                                                  cv::Mat &detection_mat,
+                                                  cv::Mat &detection_yuv);
+static DetectionParams get_detection_params(GstFaceSticker *filter,
+                                            const cv::Size &frame_size);
+static void detect_faces(GstFaceSticker *filter, unsigned char *buffer,
+                         const cv::Mat &detection_mat,
+                         const DetectionParams &params,
+                         std::vector<FacialData> &faces);
+static void run_face_detector(GstFaceSticker *filter, unsigned char *buffer,
+                              const cv::Mat &image, const cv::Point &origin,
+                              std::vector<FacialData> &faces);
+static void detect_faces_tiled(GstFaceSticker *filter, unsigned char *buffer,
+                               const cv::Mat &detection_mat,
+                               const DetectionParams &params,
+                               std::vector<FacialData> &faces);
+static void redetect_faces(GstFaceSticker *filter,
+                           const cv::Mat &detection_mat,
+                           const cv::Size &frame_size);
+static void run_tile_jobs(GstFaceSticker *filter, const cv::Mat &detection_mat,
+                          std::vector<FacialData> &faces);
+static void compute_tile_starts(int length, int tile_size, int overlap,
+                                std::vector<int> &starts);
+static void warn_tile_overlap(GstFaceSticker *filter);
+static void suppress_overlapping_faces(std::vector<FacialData> &faces,
+                                       size_t first);
+static void scale_facial_data(FacialData &face, double scale_x,
+                              double scale_y);
+static void render_faces(GstFaceSticker *filter,
+                         const FaceStickerConfig &config, StickerCache *cache,
+                         AtlasCache *atlas_cache, FramePlanes &frame,
+                         GstClockTime pts,
+                         const std::vector<FacialData> &faces);
+static int sticker_frame(const FaceStickerConfig &config, GstClockTime pts);
+static gboolean is_result_fresh(GstFaceSticker *filter, GstClockTime pts);
+static cv::Scalar marker_color(const cv::Mat &canvas, const cv::Scalar &bgr);
 static void draw_facial_landmarks(cv::Mat &frame_mat, const FacialData &face,
                                   gboolean silent);
 static void draw_face_rectangle(cv::Mat &frame_mat, const FacialData &face);
 static void draw_face_confidence(cv::Mat &frame_mat, const FacialData &face);
-static void log_face_data(GstFaceSticker *filter, int face_index,
-                          const FacialData &face);
-static void apply_eye_stickers(GstFaceSticker *filter, cv::Mat &frame_mat,
-                               const FacialData &face);
+static void log_face_data(GstFaceSticker *filter, gboolean silent,
+                          int face_index, const FacialData &face);
+static void apply_eye_stickers(GstFaceSticker *filter,
+                               const FaceStickerConfig &config,
+                               StickerCache *cache, int sticker_index,
+                               FramePlanes &frame, const FacialData &face);
+static void apply_atlas_stickers(GstFaceSticker *filter,
+                                 AtlasCache *atlas_cache, FramePlanes &frame,
+                                 const FacialData &face);
+static void blend_sprite(FramePlanes &frame, const StickerSprite &sprite,
+                         const cv::Point &origin);
+static void anonymize_face(GstFaceSticker *filter,
+                           GstFaceStickerEffect effect, FramePlanes &frame,
+                           const FacialData &face);
 static void draw_default_eye_markers(cv::Mat &frame_mat,
                                      const FacialData &face);
-static void apply_eye_image_stickers(GstFaceSticker *filter, cv::Mat &frame_mat,
+static void apply_eye_image_stickers(GstFaceSticker *filter,
+                                     const FaceStickerConfig &config,
+                                     StickerCache *cache, int sticker_index,
+                                     FramePlanes &frame,
                                      const FacialData &face);
 static cv::Rect calculate_eye_roi(const cv::Point &eye_center,
                                   const cv::Mat &eye_img, int frame_width,
                                   int frame_height);
-static void apply_eye_image_to_roi(cv::Mat &frame_mat, const cv::Mat &eye_img,
-                                   const cv::Mat &eye_mask,
+static void apply_eye_image_to_roi(FramePlanes &frame,
+                                   const StickerSprite &sprite,
                                    const cv::Rect &roi);
-static FacialData extract_facial_data(short *facial_landmarks);
+static void post_stats(GstFaceSticker *filter);
+static GstPad *get_meta_pad(GstFaceSticker *filter);
+static GstBuffer *make_meta_record(GstFaceSticker *filter, GstBuffer *frame,
+                                   const std::vector<FacialData> &faces);
+static void start_meta_pad(GstFaceSticker *filter, GstPad *pad);
+static void push_meta_record(GstFaceSticker *filter, GstPad *pad,
+                             GstBuffer *record);
+static void push_meta_event(GstFaceSticker *filter, GstEvent *event);
+static void emit_meta_record(GstFaceSticker *filter, GstBuffer *frame,
+                             const std::vector<FacialData> &faces);
+static void attach_meta_record(GstFaceSticker *filter, GstBuffer *frame,
+                               const std::vector<FacialData> &faces);
+static void push_attached_meta_record(GstFaceSticker *filter,
+                                      GstBuffer *frame);
 
 /* GObject vmethod implementations */
 
@@ -128,15 +442,92 @@ static void gst_face_sticker_class_init(GstFaceStickerClass *klass) {
   gobject_class->finalize = gst_face_sticker_finalize;
 
   base_transform_class->set_caps = GST_DEBUG_FUNCPTR(gst_face_sticker_set_caps);
+  base_transform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR(gst_face_sticker_propose_allocation);
+  base_transform_class->start = GST_DEBUG_FUNCPTR(gst_face_sticker_start);
+  base_transform_class->stop = GST_DEBUG_FUNCPTR(gst_face_sticker_stop);
+  base_transform_class->src_event =
+      GST_DEBUG_FUNCPTR(gst_face_sticker_src_event);
+  base_transform_class->sink_event =
+      GST_DEBUG_FUNCPTR(gst_face_sticker_sink_event);
+  base_transform_class->submit_input_buffer =
+      GST_DEBUG_FUNCPTR(gst_face_sticker_submit_input_buffer);
+  base_transform_class->generate_output =
+      GST_DEBUG_FUNCPTR(gst_face_sticker_generate_output);
   base_transform_class->transform_ip =
       GST_DEBUG_FUNCPTR(gst_face_sticker_transform_ip);
 
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR(gst_face_sticker_request_new_pad);
+  gstelement_class->release_pad =
+      GST_DEBUG_FUNCPTR(gst_face_sticker_release_pad);
+
   g_object_class_install_property(
       gobject_class, PROP_SILENT,
       g_param_spec_boolean(
           "silent", "Silent", "Produce verbose output?", FALSE,
           (GParamFlags)(G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE)));
 
+  g_object_class_install_property(
+      gobject_class, PROP_MODE,
+      g_param_spec_enum("mode", "Mode",
+                        "Detect and draw, only detect and attach the faces as "
+                        "region of interest meta, or only draw the faces "
+                        "found in such meta",
+                        GST_TYPE_FACE_STICKER_MODE, DEFAULT_MODE,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_OVERLAY_COMPOSITION,
+      g_param_spec_boolean("overlay_composition", "Overlay composition",
+                           "Attach the stickers as overlay composition meta "
+                           "for downstream to blend instead of drawing into "
+                           "the frame",
+                           DEFAULT_OVERLAY_COMPOSITION,
+                           (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_DETECTOR,
+      g_param_spec_enum("detector", "Detector",
+                        "Face detection backend", GST_TYPE_FACE_STICKER_DETECTOR,
+                        DEFAULT_DETECTOR,
+                        (GParamFlags)(G_PARAM_READWRITE |
+                                      GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_DETECTOR_MODEL,
+      g_param_spec_string("detector_model", "Detector model",
+                          "Model file of the yunet (ONNX) or cascade (XML) "
+                          "detector",
+                          NULL,
+                          (GParamFlags)(G_PARAM_READWRITE |
+                                        GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_TRACE_MODE,
+      g_param_spec_enum("trace_mode", "Trace mode",
+                        "Record every frame's faces to trace_path, or replay "
+                        "them from it instead of running the detector",
+                        GST_TYPE_FACE_STICKER_TRACE_MODE, DEFAULT_TRACE_MODE,
+                        (GParamFlags)(G_PARAM_READWRITE |
+                                      GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_META_FORMAT,
+      g_param_spec_enum("meta_format", "Meta format",
+                        "Format of the detection records pushed on the "
+                        "meta_src request pad",
+                        GST_TYPE_FACE_STICKER_META_FORMAT, DEFAULT_META_FORMAT,
+                        (GParamFlags)(G_PARAM_READWRITE |
+                                      GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_TRACE_PATH,
+      g_param_spec_string("trace_path", "Trace path",
+                          "Binary face detection trace file", NULL,
+                          (GParamFlags)(G_PARAM_READWRITE |
+                                        GST_PARAM_MUTABLE_READY)));
+
   g_object_class_install_property(
       gobject_class, PROP_EYEIMG_PATH,
       g_param_spec_string("eye_img_path", "Eye image path",
@@ -156,6 +547,234 @@ static void gst_face_sticker_class_init(GstFaceStickerClass *klass) {
                        "Minimum confidence level for face detection", 0, 100,
                        DEFAULT_MIN_CONFIDENCE, (GParamFlags)(G_PARAM_READWRITE)));
 
+  g_object_class_install_property(
+      gobject_class, PROP_EFFECT,
+      g_param_spec_enum("effect", "Effect",
+                        "Put stickers on the eyes, or anonymize the whole "
+                        "face by pixelating or blurring it",
+                        GST_TYPE_FACE_STICKER_EFFECT, DEFAULT_EFFECT,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_STICKER_FPS,
+      g_param_spec_double("sticker_fps", "Sticker FPS",
+                          "Playback rate of animated stickers, in frames per "
+                          "second of buffer time (0 = the file's own rate)",
+                          0, 1000, DEFAULT_STICKER_FPS,
+                          (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_SPRITE_COLUMNS,
+      g_param_spec_uint("sprite_columns", "Sprite columns",
+                        "Columns of animation frames in a sprite sheet "
+                        "given as eye_img_path",
+                        1, 64, DEFAULT_SPRITE_COLUMNS,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_SPRITE_ROWS,
+      g_param_spec_uint("sprite_rows", "Sprite rows",
+                        "Rows of animation frames in a sprite sheet given as "
+                        "eye_img_path",
+                        1, 64, DEFAULT_SPRITE_ROWS,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_ATLAS_PATH,
+      g_param_spec_string("atlas_path", "Atlas path",
+                          "Key file describing a sticker atlas: sprites cut "
+                          "from one image and placed on the eyes, nose, "
+                          "mouth or face, turned with the eye line. Used "
+                          "instead of eye_img_path while set",
+                          NULL, (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_ASYNC_DETECTION,
+      g_param_spec_boolean(
+          "async_detection", "Asynchronous detection",
+          "Run face detection on a dedicated worker thread and stamp stickers "
+          "using the newest finished result",
+          DEFAULT_ASYNC_DETECTION, (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_DETECTION_INTERVAL,
+      g_param_spec_uint("detection_interval", "Detection interval",
+                        "Submit every Nth frame to the detection worker", 1,
+                        G_MAXUINT, DEFAULT_DETECTION_INTERVAL,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_MAX_RESULT_AGE,
+      g_param_spec_uint("max_result_age", "Maximum result age",
+                        "Drop asynchronous detection results older than this "
+                        "many milliseconds (0 = never drop)",
+                        0, G_MAXUINT, DEFAULT_MAX_RESULT_AGE,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_DETECTION_WIDTH,
+      g_param_spec_uint("detection_width", "Detection width",
+                        "Run face detection on a copy of the frame downscaled "
+                        "to this width (0 = full resolution)",
+                        0, G_MAXUINT, DEFAULT_DETECTION_WIDTH,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_KEYFRAME_INTERVAL,
+      g_param_spec_uint("keyframe_interval", "Keyframe interval",
+                        "Run the face detector only every Nth frame and track "
+                        "the faces with optical flow in between (1 = detect "
+                        "every frame)",
+                        1, G_MAXUINT, DEFAULT_KEYFRAME_INTERVAL,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_TILE_SIZE,
+      g_param_spec_uint("tile_size", "Tile size",
+                        "Split the detection image into overlapping tiles of "
+                        "this many pixels and detect on them in parallel "
+                        "(0 = detect on the whole image)",
+                        0, G_MAXUINT, DEFAULT_TILE_SIZE,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_TILE_OVERLAP,
+      g_param_spec_uint("tile_overlap", "Tile overlap",
+                        "Number of pixels adjacent tiles overlap by, at most "
+                        "half the tile size", 0,
+                        G_MAXUINT, DEFAULT_TILE_OVERLAP,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_DETECTION_THREADS,
+      g_param_spec_uint("detection_threads", "Detection threads",
+                        "Number of worker threads for tiled detection "
+                        "(0 = one per CPU)",
+                        0, 256, DEFAULT_DETECTION_THREADS,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_N_THREADS,
+      g_param_spec_uint("n_threads", "Inference threads",
+                        "Upper bound on the threads running inference, "
+                        "OpenMP threads of the detector included "
+                        "(0 = unbounded)",
+                        0, 256, DEFAULT_N_THREADS,
+                        (GParamFlags)(G_PARAM_READWRITE |
+                                      GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_CPU_AFFINITY,
+      g_param_spec_string("cpu_affinity", "CPU affinity",
+                          "CPUs the inference threads are pinned to, e.g. "
+                          "\"0-3,6\" (NULL = not pinned)",
+                          NULL,
+                          (GParamFlags)(G_PARAM_READWRITE |
+                                        GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_PARALLEL_FRAMES,
+      g_param_spec_uint("parallel_frames", "Parallel frames",
+                        "Detect and draw on up to this many frames at once "
+                        "and push them in order, for throughput-bound "
+                        "offline pipelines (0 = one frame at a time)",
+                        0, 64, DEFAULT_PARALLEL_FRAMES,
+                        (GParamFlags)(G_PARAM_READWRITE |
+                                      GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_SHARED_DETECTION,
+      g_param_spec_boolean(
+          "shared_detection", "Shared detection",
+          "In async mode, send frames to the detection engine shared by all "
+          "face_sticker instances in the process instead of a private worker",
+          DEFAULT_SHARED_DETECTION, (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_DETECTION_PRIORITY,
+      g_param_spec_uint("detection_priority", "Detection priority",
+                        "Share of the shared detection engine this stream "
+                        "gets relative to the other streams",
+                        1, 100, DEFAULT_DETECTION_PRIORITY,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_MAX_IN_FLIGHT,
+      g_param_spec_uint("max_in_flight", "Maximum frames in flight",
+                        "Maximum number of this stream's frames queued or "
+                        "being detected by the shared detection engine",
+                        1, 64, DEFAULT_MAX_IN_FLIGHT,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+                         "Frame, detection and face counters and per-stage "
+                         "latencies (min/mean/p95/p99 in nanoseconds)",
+                         GST_TYPE_STRUCTURE,
+                         (GParamFlags)(G_PARAM_READABLE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint("stats_interval", "Statistics interval",
+                        "Post the statistics as an element message on the bus "
+                        "every this many milliseconds (0 = never)",
+                        0, G_MAXUINT, DEFAULT_STATS_INTERVAL,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_ADAPTIVE_QOS,
+      g_param_spec_boolean("adaptive_qos", "Adaptive QoS",
+                           "Detect less often and on smaller images while "
+                           "downstream reports frames arriving late",
+                           DEFAULT_ADAPTIVE_QOS,
+                           (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_SCENE_THRESHOLD,
+      g_param_spec_double("scene_threshold", "Scene change threshold",
+                          "Reuse the previous faces while the mean luma "
+                          "difference to the last processed frame stays "
+                          "below this (0-255, 0 = always detect)",
+                          0.0, 255.0, DEFAULT_SCENE_THRESHOLD,
+                          (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_SCENE_MAX_REUSE,
+      g_param_spec_uint("scene_max_reuse", "Scene max reuse",
+                        "Reuse the previous faces for at most this many "
+                        "consecutive frames (0 = no limit)",
+                        0, G_MAXUINT, DEFAULT_SCENE_MAX_REUSE,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_FULL_SCAN_INTERVAL,
+      g_param_spec_uint("full_scan_interval", "Full scan interval",
+                        "Scan the whole frame only every Nth frame and search "
+                        "just around the previous faces in between "
+                        "(0 = always scan the whole frame)",
+                        0, G_MAXUINT, DEFAULT_FULL_SCAN_INTERVAL,
+                        (GParamFlags)(G_PARAM_READWRITE)));
+
+  g_object_class_install_property(
+      gobject_class, PROP_ROI_EXPANSION,
+      g_param_spec_double("roi_expansion", "ROI expansion",
+                          "Size of the region searched around a previous "
+                          "face, relative to the face size",
+                          1.0, 10.0, DEFAULT_ROI_EXPANSION,
+                          (GParamFlags)(G_PARAM_READWRITE)));
+
+  gst_type_mark_as_plugin_api(GST_TYPE_FACE_STICKER_MODE,
+                              (GstPluginAPIFlags)0);
+  gst_type_mark_as_plugin_api(GST_TYPE_FACE_STICKER_TRACE_MODE,
+                              (GstPluginAPIFlags)0);
+  gst_type_mark_as_plugin_api(GST_TYPE_FACE_STICKER_DETECTOR,
+                              (GstPluginAPIFlags)0);
+  gst_type_mark_as_plugin_api(GST_TYPE_FACE_STICKER_EFFECT,
+                              (GstPluginAPIFlags)0);
+  gst_type_mark_as_plugin_api(GST_TYPE_FACE_STICKER_META_FORMAT,
+                              (GstPluginAPIFlags)0);
+
   gst_element_class_set_details_simple(
       gstelement_class, "FaceSticker", "Filter/Effect/Video",
       "Detects faces and applies stickers over eye regions",
@@ -165,6 +784,10 @@ static void gst_face_sticker_class_init(GstFaceStickerClass *klass) {
       gstelement_class, gst_static_pad_template_get(&src_template));
   gst_element_class_add_pad_template(
       gstelement_class, gst_static_pad_template_get(&sink_template));
+  gst_element_class_add_pad_template(
+      gstelement_class, gst_static_pad_template_get(&meta_src_template));
+
+  meta_record_quark = g_quark_from_static_string("face-sticker-meta-record");
 
   /* debug category for fltering log messages
    *
@@ -193,283 +816,2570 @@ static gboolean gst_face_sticker_set_caps(GstBaseTransform *trans,
   GST_DEBUG_OBJECT(filter, "Output video format: %dx%d", filter->out_info.width,
                    filter->out_info.height);
 
+  filter->sticker_cache->set_format(GST_VIDEO_INFO_FORMAT(&filter->in_info));
+  filter->atlas_cache->set_format(GST_VIDEO_INFO_FORMAT(&filter->in_info));
+
+  /* drained by the caps event, rebuilt for the new format on the next
+   * buffer */
+  destroy_frame_queue(filter);
+
+  filter->overlay_checked = FALSE;
+
   return TRUE;
 }
 
-/* initialize the new element
- * initialize instance structure
- */
-static void gst_face_sticker_init(GstFaceSticker *filter) {
-  filter->silent = FALSE;
-  filter->eye_img_path = NULL;
-  filter->eye_img_scale = DEFAULT_EYE_IMG_SCALE;
-
-  filter->min_confidence = DEFAULT_MIN_CONFIDENCE;
+/* Rows of every plane start on a FRAME_ALIGNMENT boundary so that the
+ * vectorized blend and the detector can read them without repacking. */
+static void get_frame_alignment(GstVideoAlignment *align) {
+  gst_video_alignment_reset(align);
 
-  filter->face_detection_buffer = (unsigned char *)malloc(DETECT_BUFFER_SIZE);
-  if (!filter->face_detection_buffer) {
-    GST_ERROR_OBJECT(filter, "Failed to allocate face detection buffer");
+  for (guint i = 0; i < GST_VIDEO_MAX_PLANES; i++) {
+    align->stride_align[i] = FRAME_ALIGNMENT - 1;
   }
 }
 
-static void gst_face_sticker_finalize(GObject *object) {
-  GstFaceSticker *filter = GST_FACESTICKER(object);
+/* Frames are always processed in place, so basetransform never decides an
+ * output allocation of its own and hands the query to downstream (the
+ * parent's propose_allocation with a NULL @decide_query). Whatever upstream
+ * allocates ends up downstream unchanged, so downstream's answer stands; a
+ * pool of aligned buffers is only added when it offered none, with padded
+ * strides only when it accepts GstVideoMeta and can find the padding. */
+static gboolean gst_face_sticker_propose_allocation(GstBaseTransform *trans,
+                                                   GstQuery *decide_query,
+                                                   GstQuery *query) {
+  GstFaceSticker *filter = GST_FACESTICKER(trans);
+  GstCaps *caps;
+  gboolean need_pool;
+  GstVideoInfo info;
 
-  if (filter->face_detection_buffer) {
-    free(filter->face_detection_buffer);
-    filter->face_detection_buffer = NULL;
+  if (!GST_BASE_TRANSFORM_CLASS(parent_class)
+           ->propose_allocation(trans, decide_query, query)) {
+    GST_DEBUG_OBJECT(filter, "Downstream did not answer the allocation query");
   }
 
-  if (filter->eye_img_path) {
-    g_free(filter->eye_img_path);
-    filter->eye_img_path = NULL;
+  gst_query_parse_allocation(query, &caps, &need_pool);
+  if (caps == NULL || !gst_video_info_from_caps(&info, caps)) {
+    GST_DEBUG_OBJECT(filter, "Invalid caps in allocation query");
+    return FALSE;
   }
 
-  G_OBJECT_CLASS(parent_class)->finalize(object);
-}
-
-static void gst_face_sticker_set_property(GObject *object, guint prop_id,
-                                          const GValue *value,
-                                          GParamSpec *pspec) {
-  GstFaceSticker *filter = GST_FACESTICKER(object);
-
-  switch (prop_id) {
-  case PROP_SILENT:
-    filter->silent = g_value_get_boolean(value);
-    break;
-
-  case PROP_EYEIMG_PATH: {
-    const gchar *path = g_value_get_string(value);
+  gboolean video_meta =
+      gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE, NULL);
+
+  GstAllocationParams params;
+  gst_allocation_params_init(&params);
+  params.align = FRAME_ALIGNMENT - 1;
+
+  if (need_pool && gst_query_get_n_allocation_pools(query) == 0) {
+    GstBufferPool *pool = gst_video_buffer_pool_new();
+    GstStructure *config = gst_buffer_pool_get_config(pool);
+    guint size;
+
+    gst_buffer_pool_config_set_params(config, caps, info.size, 0, 0);
+    gst_buffer_pool_config_set_allocator(config, NULL, &params);
+    if (video_meta) {
+      GstVideoAlignment align;
+
+      get_frame_alignment(&align);
+      gst_buffer_pool_config_add_option(config,
+                                        GST_BUFFER_POOL_OPTION_VIDEO_META);
+      gst_buffer_pool_config_add_option(
+          config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+      gst_buffer_pool_config_set_video_alignment(config, &align);
+    }
 
-    if (filter->eye_img_path) {
-      g_free(filter->eye_img_path);
+    if (!gst_buffer_pool_set_config(pool, config)) {
+      GST_WARNING_OBJECT(filter, "Failed to configure proposed buffer pool");
+      gst_object_unref(pool);
+      return FALSE;
     }
 
-    filter->eye_img_path = g_strdup(path);
+    /* the pool grows the buffer size to fit the padding */
+    config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_get_params(config, NULL, &size, NULL, NULL);
+    gst_structure_free(config);
 
-    if (path && *path) {
-      filter->eye_img = cv::imread(path, cv::IMREAD_COLOR);
-      if (filter->eye_img.empty()) {
-        GST_WARNING_OBJECT(filter, "Failed to load eye image from %s", path);
-      } else {
-        GST_DEBUG_OBJECT(filter, "Successfully loaded eye image from %s", path);
-      }
-    }
-    break;
+    gst_query_add_allocation_pool(query, pool, size, 0, 0);
+    gst_object_unref(pool);
   }
 
-  case PROP_EYEIMG_SCALE:
-    filter->eye_img_scale = g_value_get_float(value);
-    GST_DEBUG_OBJECT(filter, "Eye image scale set to %f",
-                     filter->eye_img_scale);
-    break;
-
-  case PROP_MIN_CONFIDENCE:
-    filter->min_confidence = g_value_get_int(value);
-    GST_DEBUG_OBJECT(filter, "Minimum confidence set to %d",
-                     filter->min_confidence);
-    break;
-  default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
-    break;
+  if (gst_query_get_n_allocation_params(query) == 0) {
+    gst_query_add_allocation_param(query, NULL, &params);
   }
+
+  return TRUE;
 }
 
-static void gst_face_sticker_get_property(GObject *object, guint prop_id,
-                                          GValue *value, GParamSpec *pspec) {
-  GstFaceSticker *filter = GST_FACESTICKER(object);
+static gboolean gst_face_sticker_start(GstBaseTransform *trans) {
+  GstFaceSticker *filter = GST_FACESTICKER(trans);
 
-  switch (prop_id) {
-  case PROP_SILENT:
-    g_value_set_boolean(value, filter->silent);
-    break;
+  filter->frame_count = 0;
+  filter->faces.clear();
+  filter->faces_pts = GST_CLOCK_TIME_NONE;
+  filter->faces_generation = 0;
 
-  case PROP_EYEIMG_PATH:
-    g_value_set_string(value, filter->eye_img_path);
-    break;
+  filter->stats->reset();
+  filter->last_stats_post = GST_CLOCK_TIME_NONE;
 
-  case PROP_EYEIMG_SCALE:
-    g_value_set_float(value, filter->eye_img_scale);
-    break;
-  case PROP_MIN_CONFIDENCE:
-    g_value_set_int(value, filter->min_confidence);
-    break;
-  default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
-    break;
+  GST_OBJECT_LOCK(filter);
+  filter->qos_proportion = 1.0;
+  filter->qos_jitter = 0;
+  GST_OBJECT_UNLOCK(filter);
+  filter->qos_level = 0;
+  filter->qos_level_frame = 0;
+
+  if (filter->face_tracker) {
+    filter->face_tracker->reset();
   }
-}
 
-static void draw_default_eye_markers(cv::Mat &frame_mat,
-                                     const FacialData &face) {
-  cv::circle(frame_mat, face.leftEye, 1, cv::Scalar(255, 0, 0), 2); // left eye
-  cv::circle(frame_mat, face.rightEye, 1, cv::Scalar(0, 0, 255),
-             2); // right eye
+  filter->scene_detector->reset();
+  filter->scene_reuse_count = 0;
+
+  filter->parallel_active = filter->parallel_frames > 0;
+  if (filter->parallel_active &&
+      (filter->async_detection ||
+       filter->config->load()->overlay_composition ||
+       filter->trace_mode != GST_FACE_STICKER_TRACE_NONE)) {
+    GST_WARNING_OBJECT(filter, "parallel_frames does not combine with async "
+                               "detection, overlay composition or traces, "
+                               "processing one frame at a time");
+    filter->parallel_active = FALSE;
+  }
+
+  return configure_threads(filter) && create_face_detector(filter) &&
+         open_trace(filter);
 }
 
-static cv::Rect calculate_eye_roi(const cv::Point &eye_center,
-                                  const cv::Mat &eye_img, int frame_width,
-                                  int frame_height) {
-  int eye_x = eye_center.x - (eye_img.cols / 2);
-  int eye_y = eye_center.y - (eye_img.rows / 2);
+/* Parses cpu_affinity and sets up the thread config every pool, worker and
+ * the streaming thread's detection follow until the next start. */
+static gboolean configure_threads(GstFaceSticker *filter) {
+  InferenceThreadConfig &config = filter->thread_config;
 
-  eye_x = std::max(0, std::min(eye_x, frame_width - eye_img.cols));
-  eye_y = std::max(0, std::min(eye_y, frame_height - eye_img.rows));
+  config.n_threads = (int)filter->n_threads;
+  if (!inference_threads_parse_cpus(filter->cpu_affinity, config.cpus)) {
+    GST_ELEMENT_ERROR(filter, RESOURCE, SETTINGS,
+                      ("Invalid CPU list \"%s\"", filter->cpu_affinity),
+                      ("Expected comma separated CPUs or ranges, e.g. 0-3,6"));
+    return FALSE;
+  }
 
-  return cv::Rect(eye_x, eye_y, eye_img.cols, eye_img.rows);
+  report_threads(filter, 1);
+  return TRUE;
 }
 
-static void apply_eye_image_to_roi(cv::Mat &frame_mat, const cv::Mat &eye_img,
-                                   const cv::Mat &eye_mask,
-                                   const cv::Rect &roi) {
-  if (roi.width > 0 && roi.height > 0 && roi.x >= 0 && roi.y >= 0 &&
-      roi.x + roi.width <= frame_mat.cols &&
-      roi.y + roi.height <= frame_mat.rows) {
-    eye_img.copyTo(frame_mat(roi), eye_mask != 255);
+/* Records in the stats that @concurrency threads are running inference at
+ * once, each with its share of the OpenMP threads. */
+static void report_threads(GstFaceSticker *filter, int concurrency) {
+  int openmp_threads = inference_threads_openmp_max();
+  int share = inference_threads_openmp_share(filter->thread_config,
+                                             concurrency);
+
+  if (openmp_threads > 0 && share > 0) {
+    openmp_threads = share;
   }
-}
 
-static void apply_eye_image_stickers(GstFaceSticker *filter, cv::Mat &frame_mat,
-                                     const FacialData &face) {
-  cv::Mat eye_img_resized;
-  cv::Mat eye_mask;
+  filter->stats->set_threads((guint)concurrency, (guint)openmp_threads);
+}
 
-  cv::resize(filter->eye_img, eye_img_resized,
-             cv::Size(face.width * filter->eye_img_scale,
-                      face.height * filter->eye_img_scale));
+/* Creates the backend selected by the detector property. */
+static gboolean create_face_detector(GstFaceSticker *filter) {
+  std::string error;
 
-  cvtColor(eye_img_resized, eye_mask, cv::COLOR_BGR2GRAY);
+  delete filter->face_detector;
+  filter->face_detector = NULL;
 
-  cv::Rect roi_left_eye = calculate_eye_roi(face.leftEye, eye_img_resized,
-                                            frame_mat.cols, frame_mat.rows);
-  cv::Rect roi_right_eye = calculate_eye_roi(face.rightEye, eye_img_resized,
-                                             frame_mat.cols, frame_mat.rows);
+  switch (filter->detector) {
+  case GST_FACE_STICKER_DETECTOR_YUNET: {
+    YuNetFaceDetector *yunet = new YuNetFaceDetector();
+    filter->face_detector = yunet;
+    if (!yunet->load(filter->detector_model, error)) {
+      break;
+    }
+    return TRUE;
+  }
+  case GST_FACE_STICKER_DETECTOR_CASCADE: {
+    CascadeFaceDetector *cascade = new CascadeFaceDetector();
+    filter->face_detector = cascade;
+    if (!cascade->load(filter->detector_model, error)) {
+      break;
+    }
+    return TRUE;
+  }
+  default:
+    filter->face_detector = new CnnFaceDetector();
+    return TRUE;
+  }
 
-  apply_eye_image_to_roi(frame_mat, eye_img_resized, eye_mask, roi_left_eye);
-  apply_eye_image_to_roi(frame_mat, eye_img_resized, eye_mask, roi_right_eye);
+  GST_ELEMENT_ERROR(filter, RESOURCE, OPEN_READ,
+                    ("Could not create the face detector"),
+                    ("%s", error.c_str()));
+  delete filter->face_detector;
+  filter->face_detector = NULL;
+  return FALSE;
 }
 
-static void apply_eye_stickers(GstFaceSticker *filter, cv::Mat &frame_mat,
-                               const FacialData &face) {
-  if (filter->eye_img.empty()) {
-    draw_default_eye_markers(frame_mat, face);
-    return;
+/* Opens trace_path for the configured trace mode. */
+static gboolean open_trace(GstFaceSticker *filter) {
+  if (filter->trace_mode == GST_FACE_STICKER_TRACE_NONE) {
+    return TRUE;
   }
 
-  apply_eye_image_stickers(filter, frame_mat, face);
-}
+  if (!filter->trace_path || !*filter->trace_path) {
+    GST_ELEMENT_ERROR(filter, RESOURCE, NOT_FOUND,
+                      ("No trace_path set for trace_mode"), (NULL));
+    return FALSE;
+  }
 
-static void draw_face_rectangle(cv::Mat &frame_mat, const FacialData &face) {
-  rectangle(frame_mat, cv::Rect(face.x, face.y, face.width, face.height),
-            cv::Scalar(0, 255, 0), 2);
-}
+  if (filter->trace_mode == GST_FACE_STICKER_TRACE_RECORD) {
+    filter->trace_writer = new FaceTraceWriter();
+    if (!filter->trace_writer->open(filter->trace_path)) {
+      GST_ELEMENT_ERROR(filter, RESOURCE, OPEN_WRITE,
+                        ("Could not open trace %s for recording",
+                         filter->trace_path),
+                        GST_ERROR_SYSTEM);
+      delete filter->trace_writer;
+      filter->trace_writer = NULL;
+      return FALSE;
+    }
+    return TRUE;
+  }
 
-static void draw_face_confidence(cv::Mat &frame_mat, const FacialData &face) {
-  cv::putText(frame_mat, std::to_string(face.confidence),
-              cv::Point(face.x, face.y - 3), cv::FONT_HERSHEY_SIMPLEX, 0.5,
-              cv::Scalar(0, 255, 0), 1);
+  GError *error = NULL;
+  filter->trace_reader = new FaceTraceReader();
+  if (!filter->trace_reader->open(filter->trace_path, &error)) {
+    GST_ELEMENT_ERROR(filter, RESOURCE, OPEN_READ,
+                      ("Could not open trace %s for replay",
+                       filter->trace_path),
+                      ("%s", error ? error->message : "unknown error"));
+    g_clear_error(&error);
+    delete filter->trace_reader;
+    filter->trace_reader = NULL;
+    return FALSE;
+  }
+
+  return TRUE;
 }
 
-static void draw_facial_landmarks(cv::Mat &frame_mat, const FacialData &face,
-                                  gboolean silent) {
-  draw_face_confidence(frame_mat, face);
-  draw_face_rectangle(frame_mat, face);
+static gboolean gst_face_sticker_stop(GstBaseTransform *trans) {
+  GstFaceSticker *filter = GST_FACESTICKER(trans);
 
-  cv::circle(frame_mat, face.nose, 1, cv::Scalar(0, 255, 0), 2); // nose
-  cv::circle(frame_mat, face.leftMouth, 1, cv::Scalar(255, 0, 255),
-             2); // left mouth
-  cv::circle(frame_mat, face.rightMouth, 1, cv::Scalar(0, 255, 255),
-             2); // right mouth
-}
+  destroy_frame_queue(filter);
 
-static void log_face_data(GstFaceSticker *filter, int face_index,
-                          const FacialData &face) {
-  if (!filter->silent) {
-    GST_LOG_OBJECT(filter,
-                   "Face %d: confidence=%d, [%d, %d, %d, %d] (%d,%d) (%d,%d) "
-                   "(%d,%d) (%d,%d) (%d,%d)",
-                   face_index, face.confidence, face.x, face.y, face.width,
-                   face.height, face.leftEye.x, face.leftEye.y, face.rightEye.x,
-                   face.rightEye.y, face.nose.x, face.nose.y, face.leftMouth.x,
-                   face.leftMouth.y, face.rightMouth.x, face.rightMouth.y);
-  }
-}
+  delete filter->detection_worker;
+  filter->detection_worker = NULL;
 
-static void process_face_detection(GstFaceSticker *filter, cv::Mat &frame_mat) {
-  int *p_results = NULL;
+  delete filter->face_tracker;
+  filter->face_tracker = NULL;
 
-  p_results = facedetect_cnn(
-      filter->face_detection_buffer, (unsigned char *)(frame_mat.ptr(0)),
-      frame_mat.cols, frame_mat.rows, (int)frame_mat.step);
+  delete filter->detection_pool;
+  filter->detection_pool = NULL;
 
-  int num_faces = p_results ? *p_results : 0;
+  delete filter->trace_writer;
+  filter->trace_writer = NULL;
 
-  for (int i = 0; i < num_faces; i++) {
-    short *facial_landmarks = ((short *)(p_results + 1)) + 16 * i;
+  delete filter->trace_reader;
+  filter->trace_reader = NULL;
 
-    FacialData face = extract_facial_data(facial_landmarks);
+  /* after everything that may still be detecting */
+  delete filter->face_detector;
+  filter->face_detector = NULL;
 
-    if (face.confidence > filter->min_confidence) {
-      draw_facial_landmarks(frame_mat, face, filter->silent);
-      apply_eye_stickers(filter, frame_mat, face);
-      log_face_data(filter, i, face);
-    }
-  }
+  return TRUE;
 }
 
-static FacialData extract_facial_data(short *facial_landmarks) {
-  FacialData face;
+/* Records the QoS values sent by downstream for update_qos_level(). The
+ * event is passed on to the base class unchanged; unless its "qos" property
+ * is enabled, no frame is ever dropped. */
+static gboolean gst_face_sticker_src_event(GstBaseTransform *trans,
+                                           GstEvent *event) {
+  GstFaceSticker *filter = GST_FACESTICKER(trans);
+
+  if (GST_EVENT_TYPE(event) == GST_EVENT_QOS) {
+    gdouble proportion;
+    GstClockTimeDiff diff;
 
-  face.confidence = facial_landmarks[0];
-  face.x = facial_landmarks[1];
-  face.y = facial_landmarks[2];
-  face.width = facial_landmarks[3];
-  face.height = facial_landmarks[4];
+    gst_event_parse_qos(event, NULL, &proportion, &diff, NULL);
 
-  face.leftEye = cv::Point(facial_landmarks[5], facial_landmarks[6]);
-  face.rightEye = cv::Point(facial_landmarks[7], facial_landmarks[8]);
-  face.nose = cv::Point(facial_landmarks[9], facial_landmarks[10]);
-  face.leftMouth = cv::Point(facial_landmarks[11], facial_landmarks[12]);
-  face.rightMouth = cv::Point(facial_landmarks[13], facial_landmarks[14]);
+    GST_OBJECT_LOCK(filter);
+    filter->qos_proportion = proportion;
+    filter->qos_jitter = diff;
+    GST_OBJECT_UNLOCK(filter);
+  }
 
-  return face;
+  return GST_BASE_TRANSFORM_CLASS(parent_class)->src_event(trans, event);
 }
 
-/* GstBaseTransform vmethod implementations */
+/* Keeps serialized events behind the frames still in the parallel queue by
+ * pushing those out first; a flush drops them instead. */
+static gboolean gst_face_sticker_sink_event(GstBaseTransform *trans,
+                                            GstEvent *event) {
+  GstFaceSticker *filter = GST_FACESTICKER(trans);
 
-/* this function does the actual processing
- */
-static GstFlowReturn gst_face_sticker_transform_ip(GstBaseTransform *base,
-                                                   GstBuffer *outbuf) {
-  GstFaceSticker *filter = GST_FACESTICKER(base);
-  GstVideoFrame frame;
-  int map_flags;
+  if (filter->frame_queue) {
+    if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP) {
+      filter->frame_queue->flush();
+    } else if (GST_EVENT_IS_SERIALIZED(event)) {
+      drain_frame_queue(filter);
+    }
+  }
 
-  if (GST_CLOCK_TIME_IS_VALID(GST_BUFFER_TIMESTAMP(outbuf))) {
-    gst_object_sync_values(GST_OBJECT(filter), GST_BUFFER_TIMESTAMP(outbuf));
+  switch (GST_EVENT_TYPE(event)) {
+  case GST_EVENT_FLUSH_START:
+  case GST_EVENT_FLUSH_STOP:
+  case GST_EVENT_SEGMENT:
+  case GST_EVENT_EOS:
+    push_meta_event(filter, gst_event_ref(event));
+    break;
+  default:
+    break;
   }
 
-  map_flags = GST_MAP_READ | (GstMapFlags)GST_VIDEO_FRAME_MAP_FLAG_NO_REF;
-  if (!gst_base_transform_is_passthrough(base)) {
-    map_flags |= GST_MAP_WRITE;
+  return GST_BASE_TRANSFORM_CLASS(parent_class)->sink_event(trans, event);
+}
+
+/* Creates the meta_src pad. There is at most one. Stream-start, caps and
+ * segment follow with its first record. */
+static GstPad *gst_face_sticker_request_new_pad(GstElement *element,
+                                                GstPadTemplate *templ,
+                                                const gchar *name,
+                                                const GstCaps *caps) {
+  GstFaceSticker *filter = GST_FACESTICKER(element);
+  GstPad *pad;
+  gboolean active;
+
+  GST_OBJECT_LOCK(filter);
+  if (filter->meta_pad) {
+    GST_OBJECT_UNLOCK(filter);
+    GST_WARNING_OBJECT(filter, "meta_src has already been requested");
+    return NULL;
   }
 
-  if (!gst_video_frame_map(&frame, &filter->in_info, outbuf,
-                           (GstMapFlags)map_flags)) {
-    GST_ERROR_OBJECT(filter, "Failed to map video frame");
+  pad = gst_pad_new_from_template(templ, "meta_src");
+  filter->meta_pad = (GstPad *)gst_object_ref_sink(pad);
+  active = GST_STATE(element) > GST_STATE_READY;
+  GST_OBJECT_UNLOCK(filter);
+
+  gst_pad_use_fixed_caps(pad);
+
+  /* the element's pads were activated when it left READY; one requested
+   * later would stay flushing and drop every record */
+  if (active) {
+    gst_pad_set_active(pad, TRUE);
+  }
+  gst_element_add_pad(element, pad);
+  return pad;
+}
+
+static void gst_face_sticker_release_pad(GstElement *element, GstPad *pad) {
+  GstFaceSticker *filter = GST_FACESTICKER(element);
+
+  GST_OBJECT_LOCK(filter);
+  if (pad != filter->meta_pad) {
+    GST_OBJECT_UNLOCK(filter);
+    return;
+  }
+  filter->meta_pad = NULL;
+  GST_OBJECT_UNLOCK(filter);
+
+  gst_element_remove_pad(element, pad);
+  gst_object_unref(pad);
+}
+
+/* initialize the new element
+ * initialize instance structure
+ */
+static void gst_face_sticker_init(GstFaceSticker *filter) {
+  FaceStickerConfig config;
+  config.mode = DEFAULT_MODE;
+  config.effect = DEFAULT_EFFECT;
+  config.overlay_composition = DEFAULT_OVERLAY_COMPOSITION;
+  config.sticker = std::make_shared<const StickerAsset>();
+  config.atlas = NULL;
+  config.eye_img_scale = DEFAULT_EYE_IMG_SCALE;
+  config.sticker_fps = DEFAULT_STICKER_FPS;
+  config.min_confidence = DEFAULT_MIN_CONFIDENCE;
+  config.silent = FALSE;
+  filter->config = new ConfigStore(config);
+  filter->sticker_loader = NULL;
+  filter->eye_img_path = NULL;
+  filter->sprite_columns = DEFAULT_SPRITE_COLUMNS;
+  filter->sprite_rows = DEFAULT_SPRITE_ROWS;
+  filter->atlas_path = NULL;
+
+  filter->sticker_cache = new StickerCache();
+  filter->atlas_cache = new AtlasCache();
+
+  filter->detector = DEFAULT_DETECTOR;
+  filter->detector_model = NULL;
+  filter->face_detector = NULL;
+
+  filter->n_threads = DEFAULT_N_THREADS;
+  filter->cpu_affinity = NULL;
+  new (&filter->thread_config) InferenceThreadConfig();
+
+  filter->trace_mode = DEFAULT_TRACE_MODE;
+  filter->trace_path = NULL;
+  filter->trace_writer = NULL;
+  filter->trace_reader = NULL;
+
+  filter->meta_format = DEFAULT_META_FORMAT;
+  filter->meta_pad = NULL;
+
+  filter->overlay_checked = FALSE;
+  filter->overlay_supported = FALSE;
+  filter->overlay_cache = new StickerCache();
+  filter->overlay_cache->set_format(GST_VIDEO_FORMAT_BGRA);
+  filter->overlay_atlas_cache = new AtlasCache();
+  filter->overlay_atlas_cache->set_format(GST_VIDEO_FORMAT_BGRA);
+  new (&filter->overlay_pixels)
+      std::unordered_map<const void *, GstBuffer *>();
+
+  filter->async_detection = DEFAULT_ASYNC_DETECTION;
+  filter->shared_detection = DEFAULT_SHARED_DETECTION;
+  filter->detection_priority = DEFAULT_DETECTION_PRIORITY;
+  filter->max_in_flight = DEFAULT_MAX_IN_FLIGHT;
+  filter->detection_interval = DEFAULT_DETECTION_INTERVAL;
+  filter->max_result_age = DEFAULT_MAX_RESULT_AGE;
+  filter->detection_worker = NULL;
+  filter->frame_count = 0;
+  new (&filter->faces) std::vector<FacialData>();
+  filter->faces_pts = GST_CLOCK_TIME_NONE;
+  filter->faces_generation = 0;
+
+  filter->detection_width = DEFAULT_DETECTION_WIDTH;
+  new (&filter->detection_mat) cv::Mat();
+  new (&filter->detection_yuv) cv::Mat();
+
+  filter->keyframe_interval = DEFAULT_KEYFRAME_INTERVAL;
+  filter->face_tracker = NULL;
+
+  filter->tile_size = DEFAULT_TILE_SIZE;
+  filter->tile_overlap = DEFAULT_TILE_OVERLAP;
+  filter->detection_threads = DEFAULT_DETECTION_THREADS;
+  filter->detection_pool = NULL;
+  g_mutex_init(&filter->tile_lock);
+  new (&filter->tiles) std::vector<cv::Rect>();
+  new (&filter->tile_faces) std::vector<std::vector<FacialData>>();
+
+  filter->parallel_frames = DEFAULT_PARALLEL_FRAMES;
+  filter->parallel_active = FALSE;
+  filter->frame_queue = NULL;
+  new (&filter->frame_workers) std::vector<FrameWorkerState>();
+
+  filter->scene_threshold = DEFAULT_SCENE_THRESHOLD;
+  filter->scene_max_reuse = DEFAULT_SCENE_MAX_REUSE;
+  filter->scene_detector = new SceneChangeDetector();
+  filter->scene_reuse_count = 0;
+
+  filter->full_scan_interval = DEFAULT_FULL_SCAN_INTERVAL;
+  filter->roi_expansion = DEFAULT_ROI_EXPANSION;
+
+  filter->stats = new StageStats();
+  filter->stats_interval = DEFAULT_STATS_INTERVAL;
+  filter->last_stats_post = GST_CLOCK_TIME_NONE;
+
+  filter->adaptive_qos = DEFAULT_ADAPTIVE_QOS;
+  filter->qos_proportion = 1.0;
+  filter->qos_jitter = 0;
+  filter->qos_level = 0;
+  filter->qos_level_frame = 0;
+
+  filter->face_detection_buffer = (unsigned char *)malloc(DETECT_BUFFER_SIZE);
+  if (!filter->face_detection_buffer) {
+    GST_ERROR_OBJECT(filter, "Failed to allocate face detection buffer");
+  }
+}
+
+static void gst_face_sticker_finalize(GObject *object) {
+  GstFaceSticker *filter = GST_FACESTICKER(object);
+
+  if (filter->face_detection_buffer) {
+    free(filter->face_detection_buffer);
+    filter->face_detection_buffer = NULL;
+  }
+
+  if (filter->eye_img_path) {
+    g_free(filter->eye_img_path);
+    filter->eye_img_path = NULL;
+  }
+
+  /* before the store it publishes into */
+  delete filter->sticker_loader;
+  filter->sticker_loader = NULL;
+
+  delete filter->detection_worker;
+  filter->detection_worker = NULL;
+
+  delete filter->face_tracker;
+  filter->face_tracker = NULL;
+
+  delete filter->detection_pool;
+  filter->detection_pool = NULL;
+
+  delete filter->trace_writer;
+  filter->trace_writer = NULL;
+  delete filter->trace_reader;
+  filter->trace_reader = NULL;
+  g_free(filter->trace_path);
+  filter->trace_path = NULL;
+
+  /* the pad itself goes with the element */
+  gst_clear_object(&filter->meta_pad);
+
+  delete filter->face_detector;
+  filter->face_detector = NULL;
+  g_free(filter->detector_model);
+  filter->detector_model = NULL;
+
+  g_free(filter->cpu_affinity);
+  filter->cpu_affinity = NULL;
+  filter->thread_config.~InferenceThreadConfig();
+
+  destroy_frame_queue(filter);
+  filter->frame_workers.~vector();
+
+  filter->tile_faces.~vector();
+  filter->tiles.~vector();
+  g_mutex_clear(&filter->tile_lock);
+  filter->detection_yuv.~Mat();
+  filter->detection_mat.~Mat();
+  delete filter->sticker_cache;
+  filter->sticker_cache = NULL;
+  delete filter->atlas_cache;
+  filter->atlas_cache = NULL;
+  g_free(filter->atlas_path);
+  filter->atlas_path = NULL;
+
+  clear_overlay_pixels(filter);
+  filter->overlay_pixels.~unordered_map();
+  delete filter->overlay_cache;
+  filter->overlay_cache = NULL;
+  delete filter->overlay_atlas_cache;
+  filter->overlay_atlas_cache = NULL;
+
+  delete filter->stats;
+  filter->stats = NULL;
+
+  delete filter->scene_detector;
+  filter->scene_detector = NULL;
+
+  filter->faces.~vector();
+
+  delete filter->config;
+  filter->config = NULL;
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_face_sticker_set_property(GObject *object, guint prop_id,
+                                          const GValue *value,
+                                          GParamSpec *pspec) {
+  GstFaceSticker *filter = GST_FACESTICKER(object);
+
+  switch (prop_id) {
+  case PROP_SILENT: {
+    gboolean silent = g_value_get_boolean(value);
+    filter->config->update(
+        [silent](FaceStickerConfig &config) { config.silent = silent; });
+    break;
+  }
+
+  case PROP_EYEIMG_PATH:
+    if (filter->eye_img_path) {
+      g_free(filter->eye_img_path);
+    }
+
+    filter->eye_img_path = g_value_dup_string(value);
+    load_sticker(filter);
+    break;
+
+  case PROP_EFFECT: {
+    GstFaceStickerEffect effect = (GstFaceStickerEffect)g_value_get_enum(value);
+    filter->config->update(
+        [effect](FaceStickerConfig &config) { config.effect = effect; });
+    break;
+  }
+
+  case PROP_STICKER_FPS: {
+    gdouble fps = g_value_get_double(value);
+    filter->config->update(
+        [fps](FaceStickerConfig &config) { config.sticker_fps = fps; });
+    break;
+  }
+
+  case PROP_SPRITE_COLUMNS:
+    filter->sprite_columns = g_value_get_uint(value);
+    if (filter->eye_img_path && *filter->eye_img_path) {
+      load_sticker(filter);
+    }
+    break;
+
+  case PROP_SPRITE_ROWS:
+    filter->sprite_rows = g_value_get_uint(value);
+    if (filter->eye_img_path && *filter->eye_img_path) {
+      load_sticker(filter);
+    }
+    break;
+
+  case PROP_ATLAS_PATH:
+    g_free(filter->atlas_path);
+    filter->atlas_path = g_value_dup_string(value);
+    load_atlas(filter);
+    break;
+
+  case PROP_EYEIMG_SCALE: {
+    gfloat scale = g_value_get_float(value);
+    filter->config->update(
+        [scale](FaceStickerConfig &config) { config.eye_img_scale = scale; });
+    GST_DEBUG_OBJECT(filter, "Eye image scale set to %f", scale);
+    break;
+  }
+
+  case PROP_MIN_CONFIDENCE: {
+    gint min_confidence = g_value_get_int(value);
+    filter->config->update([min_confidence](FaceStickerConfig &config) {
+      config.min_confidence = min_confidence;
+    });
+    GST_DEBUG_OBJECT(filter, "Minimum confidence set to %d", min_confidence);
+    break;
+  }
+
+  case PROP_ASYNC_DETECTION:
+    filter->async_detection = g_value_get_boolean(value);
+    break;
+
+  case PROP_DETECTION_INTERVAL:
+    filter->detection_interval = g_value_get_uint(value);
+    break;
+
+  case PROP_MAX_RESULT_AGE:
+    filter->max_result_age = g_value_get_uint(value);
+    break;
+
+  case PROP_DETECTION_WIDTH:
+    filter->detection_width = g_value_get_uint(value);
+    GST_DEBUG_OBJECT(filter, "Detection width set to %u",
+                     filter->detection_width);
+    break;
+
+  case PROP_KEYFRAME_INTERVAL:
+    filter->keyframe_interval = g_value_get_uint(value);
+    GST_DEBUG_OBJECT(filter, "Keyframe interval set to %u",
+                     filter->keyframe_interval);
+    break;
+
+  case PROP_TILE_SIZE:
+    filter->tile_size = g_value_get_uint(value);
+    warn_tile_overlap(filter);
+    break;
+
+  case PROP_TILE_OVERLAP:
+    filter->tile_overlap = g_value_get_uint(value);
+    warn_tile_overlap(filter);
+    break;
+
+  case PROP_DETECTION_THREADS:
+    filter->detection_threads = g_value_get_uint(value);
+    break;
+
+  case PROP_SHARED_DETECTION:
+    filter->shared_detection = g_value_get_boolean(value);
+    break;
+
+  case PROP_DETECTION_PRIORITY:
+    filter->detection_priority = g_value_get_uint(value);
+    break;
+
+  case PROP_MAX_IN_FLIGHT:
+    filter->max_in_flight = g_value_get_uint(value);
+    break;
+
+  case PROP_STATS_INTERVAL:
+    filter->stats_interval = g_value_get_uint(value);
+    break;
+
+  case PROP_ADAPTIVE_QOS:
+    filter->adaptive_qos = g_value_get_boolean(value);
+    break;
+
+  case PROP_SCENE_THRESHOLD:
+    filter->scene_threshold = g_value_get_double(value);
+    break;
+
+  case PROP_SCENE_MAX_REUSE:
+    filter->scene_max_reuse = g_value_get_uint(value);
+    break;
+
+  case PROP_FULL_SCAN_INTERVAL:
+    filter->full_scan_interval = g_value_get_uint(value);
+    break;
+
+  case PROP_ROI_EXPANSION:
+    filter->roi_expansion = g_value_get_double(value);
+    break;
+
+  case PROP_MODE: {
+    GstFaceStickerMode mode = (GstFaceStickerMode)g_value_get_enum(value);
+    filter->config->update(
+        [mode](FaceStickerConfig &config) { config.mode = mode; });
+    break;
+  }
+
+  case PROP_OVERLAY_COMPOSITION: {
+    gboolean overlay = g_value_get_boolean(value);
+    filter->config->update([overlay](FaceStickerConfig &config) {
+      config.overlay_composition = overlay;
+    });
+    break;
+  }
+
+  case PROP_TRACE_MODE:
+    filter->trace_mode = (GstFaceStickerTraceMode)g_value_get_enum(value);
+    break;
+
+  case PROP_DETECTOR:
+    filter->detector = (GstFaceStickerDetector)g_value_get_enum(value);
+    break;
+
+  case PROP_DETECTOR_MODEL:
+    g_free(filter->detector_model);
+    filter->detector_model = g_value_dup_string(value);
+    break;
+
+  case PROP_N_THREADS:
+    filter->n_threads = g_value_get_uint(value);
+    break;
+
+  case PROP_PARALLEL_FRAMES:
+    filter->parallel_frames = g_value_get_uint(value);
+    break;
+
+  case PROP_CPU_AFFINITY:
+    g_free(filter->cpu_affinity);
+    filter->cpu_affinity = g_value_dup_string(value);
+    break;
+
+  case PROP_TRACE_PATH:
+    g_free(filter->trace_path);
+    filter->trace_path = g_value_dup_string(value);
+    break;
+
+  case PROP_META_FORMAT:
+    filter->meta_format = (GstFaceStickerMetaFormat)g_value_get_enum(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void gst_face_sticker_get_property(GObject *object, guint prop_id,
+                                          GValue *value, GParamSpec *pspec) {
+  GstFaceSticker *filter = GST_FACESTICKER(object);
+
+  switch (prop_id) {
+  case PROP_SILENT:
+    g_value_set_boolean(value, filter->config->load()->silent);
+    break;
+
+  case PROP_EYEIMG_PATH:
+    g_value_set_string(value, filter->eye_img_path);
+    break;
+
+  case PROP_EYEIMG_SCALE:
+    g_value_set_float(value, filter->config->load()->eye_img_scale);
+    break;
+  case PROP_MIN_CONFIDENCE:
+    g_value_set_int(value, filter->config->load()->min_confidence);
+    break;
+  case PROP_EFFECT:
+    g_value_set_enum(value, filter->config->load()->effect);
+    break;
+  case PROP_STICKER_FPS:
+    g_value_set_double(value, filter->config->load()->sticker_fps);
+    break;
+  case PROP_SPRITE_COLUMNS:
+    g_value_set_uint(value, filter->sprite_columns);
+    break;
+  case PROP_SPRITE_ROWS:
+    g_value_set_uint(value, filter->sprite_rows);
+    break;
+  case PROP_ATLAS_PATH:
+    g_value_set_string(value, filter->atlas_path);
+    break;
+  case PROP_ASYNC_DETECTION:
+    g_value_set_boolean(value, filter->async_detection);
+    break;
+  case PROP_DETECTION_INTERVAL:
+    g_value_set_uint(value, filter->detection_interval);
+    break;
+  case PROP_MAX_RESULT_AGE:
+    g_value_set_uint(value, filter->max_result_age);
+    break;
+  case PROP_DETECTION_WIDTH:
+    g_value_set_uint(value, filter->detection_width);
+    break;
+  case PROP_KEYFRAME_INTERVAL:
+    g_value_set_uint(value, filter->keyframe_interval);
+    break;
+  case PROP_TILE_SIZE:
+    g_value_set_uint(value, filter->tile_size);
+    break;
+  case PROP_TILE_OVERLAP:
+    g_value_set_uint(value, filter->tile_overlap);
+    break;
+  case PROP_DETECTION_THREADS:
+    g_value_set_uint(value, filter->detection_threads);
+    break;
+  case PROP_SHARED_DETECTION:
+    g_value_set_boolean(value, filter->shared_detection);
+    break;
+  case PROP_DETECTION_PRIORITY:
+    g_value_set_uint(value, filter->detection_priority);
+    break;
+  case PROP_MAX_IN_FLIGHT:
+    g_value_set_uint(value, filter->max_in_flight);
+    break;
+  case PROP_STATS:
+    g_value_take_boxed(value, filter->stats->to_structure());
+    break;
+  case PROP_STATS_INTERVAL:
+    g_value_set_uint(value, filter->stats_interval);
+    break;
+  case PROP_ADAPTIVE_QOS:
+    g_value_set_boolean(value, filter->adaptive_qos);
+    break;
+  case PROP_SCENE_THRESHOLD:
+    g_value_set_double(value, filter->scene_threshold);
+    break;
+  case PROP_SCENE_MAX_REUSE:
+    g_value_set_uint(value, filter->scene_max_reuse);
+    break;
+  case PROP_FULL_SCAN_INTERVAL:
+    g_value_set_uint(value, filter->full_scan_interval);
+    break;
+  case PROP_ROI_EXPANSION:
+    g_value_set_double(value, filter->roi_expansion);
+    break;
+  case PROP_MODE:
+    g_value_set_enum(value, filter->config->load()->mode);
+    break;
+  case PROP_OVERLAY_COMPOSITION:
+    g_value_set_boolean(value, filter->config->load()->overlay_composition);
+    break;
+  case PROP_TRACE_MODE:
+    g_value_set_enum(value, filter->trace_mode);
+    break;
+  case PROP_DETECTOR:
+    g_value_set_enum(value, filter->detector);
+    break;
+  case PROP_DETECTOR_MODEL:
+    g_value_set_string(value, filter->detector_model);
+    break;
+  case PROP_N_THREADS:
+    g_value_set_uint(value, filter->n_threads);
+    break;
+  case PROP_PARALLEL_FRAMES:
+    g_value_set_uint(value, filter->parallel_frames);
+    break;
+  case PROP_CPU_AFFINITY:
+    g_value_set_string(value, filter->cpu_affinity);
+    break;
+  case PROP_TRACE_PATH:
+    g_value_set_string(value, filter->trace_path);
+    break;
+  case PROP_META_FORMAT:
+    g_value_set_enum(value, filter->meta_format);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+/* Debug markers on YUV frames are drawn on the luma plane only, using the
+ * BT.601 luma of the colour they have on BGR frames. */
+static cv::Scalar marker_color(const cv::Mat &canvas, const cv::Scalar &bgr) {
+  if (canvas.channels() != 1) {
+    return bgr;
+  }
+
+  return cv::Scalar(16 + (0.098 * bgr[0] + 0.504 * bgr[1] + 0.257 * bgr[2]));
+}
+
+static void draw_default_eye_markers(cv::Mat &frame_mat,
+                                     const FacialData &face) {
+  cv::circle(frame_mat, face.leftEye, 1,
+             marker_color(frame_mat, cv::Scalar(255, 0, 0)), 2); // left eye
+  cv::circle(frame_mat, face.rightEye, 1,
+             marker_color(frame_mat, cv::Scalar(0, 0, 255)), 2); // right eye
+}
+
+static cv::Rect calculate_eye_roi(const cv::Point &eye_center,
+                                  const cv::Mat &eye_img, int frame_width,
+                                  int frame_height) {
+  int eye_x = eye_center.x - (eye_img.cols / 2);
+  int eye_y = eye_center.y - (eye_img.rows / 2);
+
+  eye_x = std::max(0, std::min(eye_x, frame_width - eye_img.cols));
+  eye_y = std::max(0, std::min(eye_y, frame_height - eye_img.rows));
+
+  return cv::Rect(eye_x, eye_y, eye_img.cols, eye_img.rows);
+}
+
+static void apply_eye_image_to_roi(FramePlanes &frame,
+                                   const StickerSprite &sprite,
+                                   const cv::Rect &roi) {
+  const cv::Mat &frame_mat = frame.planes[0];
+
+  if (roi.width > 0 && roi.height > 0 && roi.x >= 0 && roi.y >= 0 &&
+      roi.x + roi.width <= frame_mat.cols &&
+      roi.y + roi.height <= frame_mat.rows) {
+    for (int p = 0; p < sprite.n_planes && p < frame.n_planes; p++) {
+      cv::Mat &plane = frame.planes[p];
+      const cv::Mat &color = sprite.color[p];
+      int x = roi.x >> frame.x_shift[p];
+      int y = roi.y >> frame.y_shift[p];
+      int width = std::min(color.cols, plane.cols - x);
+      int height = std::min(color.rows, plane.rows - y);
+      size_t row_bytes = (size_t)width * plane.elemSize();
+
+      for (int row = 0; row < height; row++) {
+        sticker_blend_row(plane.ptr(y + row, x), color.ptr(row),
+                          sprite.inv_alpha[p].ptr(row), row_bytes);
+      }
+    }
+  }
+}
+
+static void apply_eye_image_stickers(GstFaceSticker *filter,
+                                     const FaceStickerConfig &config,
+                                     StickerCache *cache, int sticker_index,
+                                     FramePlanes &frame,
+                                     const FacialData &face) {
+  const cv::Mat &frame_mat = frame.planes[0];
+
+  const StickerSprite *sprite;
+  {
+    StageTimer timer(filter->stats, STATS_STAGE_RESIZE);
+    sprite = cache->lookup(cv::Size(face.width * config.eye_img_scale,
+                                    face.height * config.eye_img_scale),
+                           sticker_index);
+  }
+  if (!sprite) {
+    return;
+  }
+
+  cv::Rect roi_left_eye = calculate_eye_roi(face.leftEye, sprite->color[0],
+                                            frame_mat.cols, frame_mat.rows);
+  cv::Rect roi_right_eye = calculate_eye_roi(face.rightEye, sprite->color[0],
+                                             frame_mat.cols, frame_mat.rows);
+
+  /* keep subsampled planes aligned with the luma plane */
+  int x_align = ~((1 << frame.x_shift[frame.n_planes - 1]) - 1);
+  int y_align = ~((1 << frame.y_shift[frame.n_planes - 1]) - 1);
+  roi_left_eye.x &= x_align;
+  roi_left_eye.y &= y_align;
+  roi_right_eye.x &= x_align;
+  roi_right_eye.y &= y_align;
+
+  StageTimer timer(filter->stats, STATS_STAGE_BLEND);
+  apply_eye_image_to_roi(frame, *sprite, roi_left_eye);
+  apply_eye_image_to_roi(frame, *sprite, roi_right_eye);
+}
+
+static void apply_eye_stickers(GstFaceSticker *filter,
+                               const FaceStickerConfig &config,
+                               StickerCache *cache, int sticker_index,
+                               FramePlanes &frame, const FacialData &face) {
+  if (config.sticker->source.empty()) {
+    StageTimer timer(filter->stats, STATS_STAGE_DRAW);
+    draw_default_eye_markers(frame.planes[0], face);
+    return;
+  }
+
+  apply_eye_image_stickers(filter, config, cache, sticker_index, frame, face);
+}
+
+/* Blends @sprite with its top left corner at @origin, clipped to the frame.
+ * @origin must be aligned to the chroma subsampling. */
+static void blend_sprite(FramePlanes &frame, const StickerSprite &sprite,
+                         const cv::Point &origin) {
+  for (int p = 0; p < sprite.n_planes && p < frame.n_planes; p++) {
+    cv::Mat &plane = frame.planes[p];
+    const cv::Mat &color = sprite.color[p];
+    size_t pixel_bytes = plane.elemSize();
+    int x = origin.x >> frame.x_shift[p];
+    int y = origin.y >> frame.y_shift[p];
+    int left = std::max(0, -x);
+    int top = std::max(0, -y);
+    int right = std::min(color.cols, plane.cols - x);
+    int bottom = std::min(color.rows, plane.rows - y);
+
+    if (left >= right) {
+      continue;
+    }
+
+    for (int row = top; row < bottom; row++) {
+      sticker_blend_row(plane.ptr(y + row, x + left),
+                        color.ptr(row) + left * pixel_bytes,
+                        sprite.inv_alpha[p].ptr(row) + left * pixel_bytes,
+                        (right - left) * pixel_bytes);
+    }
+  }
+}
+
+static void apply_atlas_stickers(GstFaceSticker *filter,
+                                 AtlasCache *atlas_cache, FramePlanes &frame,
+                                 const FacialData &face) {
+  const std::vector<AtlasPlacement> *placements;
+  {
+    StageTimer timer(filter->stats, STATS_STAGE_RESIZE);
+    placements = &atlas_cache->place(face,
+                                     1 << frame.x_shift[frame.n_planes - 1],
+                                     1 << frame.y_shift[frame.n_planes - 1]);
+  }
+
+  StageTimer timer(filter->stats, STATS_STAGE_BLEND);
+  for (const AtlasPlacement &placement : *placements) {
+    blend_sprite(frame, *placement.sprite, placement.origin);
+  }
+}
+
+/* Pixelates or blurs the box of @face on every plane. The box is aligned to
+ * the chroma subsampling, and the mosaic block to twice that, so the cells
+ * of all planes cover the same pixels. */
+static void anonymize_face(GstFaceSticker *filter,
+                           GstFaceStickerEffect effect, FramePlanes &frame,
+                           const FacialData &face) {
+  StageTimer timer(filter->stats, STATS_STAGE_ANONYMIZE);
+  const cv::Mat &frame_mat = frame.planes[0];
+  int x_align = (1 << frame.x_shift[frame.n_planes - 1]) - 1;
+  int y_align = (1 << frame.y_shift[frame.n_planes - 1]) - 1;
+
+  cv::Rect box = cv::Rect(face.x, face.y, face.width, face.height) &
+                 cv::Rect(0, 0, frame_mat.cols, frame_mat.rows);
+  int right = (box.x + box.width + x_align) & ~x_align;
+  int bottom = (box.y + box.height + y_align) & ~y_align;
+  box.x &= ~x_align;
+  box.y &= ~y_align;
+  box.width = std::min(right, frame_mat.cols) - box.x;
+  box.height = std::min(bottom, frame_mat.rows) - box.y;
+  if (box.width <= 0 || box.height <= 0) {
+    return;
+  }
+
+  int extent = std::max(box.width, box.height);
+  int block = std::max(extent / ANONYMIZE_PIXELATE_CELLS, 2) & ~1;
+  int radius = std::max(extent / ANONYMIZE_BLUR_DIVISOR, 1);
+
+  for (int p = 0; p < frame.n_planes; p++) {
+    int x_shift = frame.x_shift[p];
+    int y_shift = frame.y_shift[p];
+    cv::Mat roi = frame.planes[p](
+        cv::Rect(box.x >> x_shift, box.y >> y_shift, box.width >> x_shift,
+                 box.height >> y_shift));
+
+    if (effect == GST_FACE_STICKER_EFFECT_PIXELATE) {
+      /* square in frame pixels, subsampling is the same on both axes */
+      anonymize_pixelate(roi, block >> x_shift);
+    } else {
+      anonymize_blur(roi, std::max(radius >> x_shift, 1),
+                     ANONYMIZE_BLUR_PASSES);
+    }
+  }
+}
+
+static void draw_face_rectangle(cv::Mat &frame_mat, const FacialData &face) {
+  rectangle(frame_mat, cv::Rect(face.x, face.y, face.width, face.height),
+            marker_color(frame_mat, cv::Scalar(0, 255, 0)), 2);
+}
+
+static void draw_face_confidence(cv::Mat &frame_mat, const FacialData &face) {
+  cv::putText(frame_mat, std::to_string(face.confidence),
+              cv::Point(face.x, face.y - 3), cv::FONT_HERSHEY_SIMPLEX, 0.5,
+              marker_color(frame_mat, cv::Scalar(0, 255, 0)), 1);
+}
+
+static void draw_facial_landmarks(cv::Mat &frame_mat, const FacialData &face,
+                                  gboolean silent) {
+  draw_face_confidence(frame_mat, face);
+  draw_face_rectangle(frame_mat, face);
+
+  cv::circle(frame_mat, face.nose, 1,
+             marker_color(frame_mat, cv::Scalar(0, 255, 0)), 2); // nose
+  cv::circle(frame_mat, face.leftMouth, 1,
+             marker_color(frame_mat, cv::Scalar(255, 0, 255)),
+             2); // left mouth
+  cv::circle(frame_mat, face.rightMouth, 1,
+             marker_color(frame_mat, cv::Scalar(0, 255, 255)),
+             2); // right mouth
+}
+
+static void log_face_data(GstFaceSticker *filter, gboolean silent,
+                          int face_index, const FacialData &face) {
+  if (!silent) {
+    GST_LOG_OBJECT(filter,
+                   "Face %d: confidence=%d, [%d, %d, %d, %d] (%d,%d) (%d,%d) "
+                   "(%d,%d) (%d,%d) (%d,%d)",
+                   face_index, face.confidence, face.x, face.y, face.width,
+                   face.height, face.leftEye.x, face.leftEye.y, face.rightEye.x,
+                   face.rightEye.y, face.nose.x, face.nose.y, face.leftMouth.x,
+                   face.leftMouth.y, face.rightMouth.x, face.rightMouth.y);
+  }
+}
+
+/* Raises the QoS level while downstream reports that frames arrive late and
+ * lowers it again once processing keeps up comfortably. */
+static void update_qos_level(GstFaceSticker *filter) {
+  if (!filter->adaptive_qos) {
+    filter->qos_level = 0;
+    return;
+  }
+
+  if (filter->frame_count - filter->qos_level_frame < QOS_SETTLE_FRAMES) {
+    return;
+  }
+
+  GST_OBJECT_LOCK(filter);
+  gdouble proportion = filter->qos_proportion;
+  GstClockTimeDiff jitter = filter->qos_jitter;
+  GST_OBJECT_UNLOCK(filter);
+
+  guint level = filter->qos_level;
+  if ((proportion > QOS_OVERLOAD_PROPORTION || jitter > 0) &&
+      level < QOS_MAX_LEVEL) {
+    level++;
+  } else if (proportion < QOS_RECOVER_PROPORTION && jitter <= 0 &&
+             level > 0) {
+    level--;
+  }
+
+  if (level != filter->qos_level) {
+    GST_INFO_OBJECT(filter,
+                    "QoS level %u -> %u (proportion %f, jitter %" G_GINT64_FORMAT
+                    ")",
+                    filter->qos_level, level, proportion, (gint64)jitter);
+    filter->qos_level = level;
+    filter->qos_level_frame = filter->frame_count;
+  }
+}
+
+/* Returns @interval doubled for each QoS level, saturated so that it never
+ * wraps around to 0. */
+static guint get_qos_interval(GstFaceSticker *filter, guint interval) {
+  guint64 scaled = (guint64)interval << MIN(filter->qos_level, 8u);
+
+  return (guint)CLAMP(scaled, (guint64)1, (guint64)G_MAXINT);
+}
+
+/* Returns the width detection should run at, or 0 to run on the full frame.
+ * Each QoS level halves the configured width. */
+static guint get_detection_width(GstFaceSticker *filter, int frame_width) {
+  guint width = filter->detection_width;
+  if (width == 0 || width > (guint)frame_width) {
+    width = (guint)frame_width;
+  }
+
+  if (filter->qos_level > 0) {
+    width = std::max(width >> filter->qos_level,
+                     std::min(width, (guint)QOS_MIN_DETECTION_WIDTH));
+  }
+
+  return width < (guint)frame_width ? width : 0;
+}
+
+/* Returns the BGR image the detector should run on: the frame itself, or a
+ * copy downscaled to detection_width in @detection_mat, which is reused
+ * across frames. */
+static const cv::Mat &prepare_detection_frame(GstFaceSticker *filter,
+                                              const FramePlanes &frame,
+                                              cv::Mat &detection_mat,
+                                              cv::Mat &detection_yuv) {
+  if (frame.format != GST_VIDEO_FORMAT_BGR) {
+    return prepare_yuv_detection_frame(filter, frame, detection_mat,
+                                       detection_yuv);
+  }
+
+  const cv::Mat &frame_mat = frame.planes[0];
+  guint detection_width = get_detection_width(filter, frame_mat.cols);
+
+  if (detection_width == 0) {
+    return frame_mat;
+  }
+
+  int width = (int)detection_width;
+  int height = std::max(
+      1, (int)((gint64)frame_mat.rows * width / frame_mat.cols));
+
+  cv::resize(frame_mat, detection_mat, cv::Size(width, height), 0, 0,
+             cv::INTER_AREA);
+
+  return detection_mat;
+}
+
+/* Downscales the Y and chroma planes into one contiguous 4:2:0 buffer,
+ * @detection_yuv, and converts only that proxy to BGR. */
+static const cv::Mat &prepare_yuv_detection_frame(GstFaceSticker *filter,
+                                                  const FramePlanes &frame,
+                                                  cv::Mat &detection_mat,
+                                                  cv::Mat &detection_yuv) {
+  const cv::Mat &luma = frame.planes[0];
+
+  int width = luma.cols;
+  guint detection_width = get_detection_width(filter, luma.cols);
+  if (detection_width > 0) {
+    width = (int)detection_width;
+  }
+  int height = (int)((gint64)luma.rows * width / luma.cols);
+
+  width = std::max(2, width & ~1);
+  height = std::max(2, height & ~1);
+
+  cv::Size chroma_size(width / 2, height / 2);
+  detection_yuv.create(height * 3 / 2, width, CV_8UC1);
+
+  cv::Mat y(height, width, CV_8UC1, detection_yuv.ptr(0));
+  cv::resize(luma, y, y.size(), 0, 0, cv::INTER_AREA);
+
+  unsigned char *chroma = detection_yuv.ptr(height);
+
+  if (frame.format == GST_VIDEO_FORMAT_NV12) {
+    cv::Mat uv(chroma_size, CV_8UC2, chroma);
+    cv::resize(frame.planes[1], uv, chroma_size, 0, 0, cv::INTER_AREA);
+    cv::cvtColor(detection_yuv, detection_mat,
+                 cv::COLOR_YUV2BGR_NV12);
+  } else {
+    cv::Mat u(chroma_size, CV_8UC1, chroma);
+    cv::Mat v(chroma_size, CV_8UC1, chroma + chroma_size.area());
+    cv::resize(frame.planes[1], u, chroma_size, 0, 0, cv::INTER_AREA);
+    cv::resize(frame.planes[2], v, chroma_size, 0, 0, cv::INTER_AREA);
+    cv::cvtColor(detection_yuv, detection_mat,
+                 cv::COLOR_YUV2BGR_I420);
+  }
+
+  return detection_mat;
+}
+
+static void scale_facial_data(FacialData &face, double scale_x,
+                              double scale_y) {
+  face.x = cvRound(face.x * scale_x);
+  face.y = cvRound(face.y * scale_y);
+  face.width = cvRound(face.width * scale_x);
+  face.height = cvRound(face.height * scale_y);
+
+  cv::Point *points[] = {&face.leftEye, &face.rightEye, &face.nose,
+                         &face.leftMouth, &face.rightMouth};
+  for (cv::Point *point : points) {
+    point->x = cvRound(point->x * scale_x);
+    point->y = cvRound(point->y * scale_y);
+  }
+}
+
+/* Runs the detection backend on @image and appends the faces above
+ * min_confidence to @faces, moved by @origin. */
+static void run_face_detector(GstFaceSticker *filter, unsigned char *buffer,
+                              const cv::Mat &image, const cv::Point &origin,
+                              std::vector<FacialData> &faces) {
+  gint min_confidence = filter->config->load()->min_confidence;
+  size_t first = faces.size();
+  size_t kept = first;
+
+  filter->face_detector->detect(buffer, image, faces);
+
+  for (size_t i = first; i < faces.size(); i++) {
+    FacialData face = faces[i];
+
+    if (face.confidence > min_confidence) {
+      face.x += origin.x;
+      face.y += origin.y;
+
+      cv::Point *points[] = {&face.leftEye, &face.rightEye, &face.nose,
+                             &face.leftMouth, &face.rightMouth};
+      for (cv::Point *point : points) {
+        *point += origin;
+      }
+
+      faces[kept++] = face;
+    }
+  }
+
+  faces.resize(kept);
+}
+
+/* Tile origins along one axis: @tile_size apart minus @overlap, with the
+ * last tile moved back to end at the image border. */
+static void compute_tile_starts(int length, int tile_size, int overlap,
+                                std::vector<int> &starts) {
+  starts.clear();
+
+  if (length <= tile_size) {
+    starts.push_back(0);
+    return;
+  }
+
+  int step = tile_size - overlap;
+  g_assert(step > 0);
+  for (int start = 0;; start += step) {
+    if (start + tile_size >= length) {
+      starts.push_back(length - tile_size);
+      break;
+    }
+    starts.push_back(start);
+  }
+}
+
+/* tile_overlap is limited to half of tile_size when tiles are laid out;
+ * anything more would multiply the tiles, one per pixel at worst. The two
+ * may be set in any order, so a larger value is kept but reported. */
+static void warn_tile_overlap(GstFaceSticker *filter) {
+  if (filter->tile_size > 0 && filter->tile_overlap > filter->tile_size / 2) {
+    GST_WARNING_OBJECT(filter,
+                       "tile_overlap %u is more than half of tile_size %u, "
+                       "using %u",
+                       filter->tile_overlap, filter->tile_size,
+                       filter->tile_size / 2);
+  }
+}
+
+/* Keeps the most confident of any faces that overlap, as happens when a face
+ * lies in the overlap of two tiles or is cut by a tile border. */
+static void suppress_overlapping_faces(std::vector<FacialData> &faces,
+                                       size_t first) {
+  std::sort(faces.begin() + first, faces.end(),
+            [](const FacialData &a, const FacialData &b) {
+              return a.confidence > b.confidence;
+            });
+
+  size_t kept = first;
+  for (size_t i = first; i < faces.size(); i++) {
+    cv::Rect rect(faces[i].x, faces[i].y, faces[i].width, faces[i].height);
+    gboolean suppressed = FALSE;
+
+    for (size_t j = first; j < kept && !suppressed; j++) {
+      cv::Rect other(faces[j].x, faces[j].y, faces[j].width, faces[j].height);
+      double intersection = (rect & other).area();
+      double smaller = std::min(rect.area(), other.area());
+
+      suppressed = intersection > NMS_IOU_THRESHOLD *
+                                      (rect.area() + other.area() -
+                                       intersection) ||
+                   (smaller > 0 &&
+                    intersection > NMS_CONTAINMENT_THRESHOLD * smaller);
+    }
+
+    if (!suppressed) {
+      faces[kept++] = faces[i];
+    }
+  }
+
+  faces.resize(kept);
+}
+
+/* Detects on overlapping tiles of @detection_mat, on the detection pool or,
+ * with @params.inline_tiles, one by one on the calling thread's @buffer. */
+static void detect_faces_tiled(GstFaceSticker *filter, unsigned char *buffer,
+                               const cv::Mat &detection_mat,
+                               const DetectionParams &params,
+                               std::vector<FacialData> &faces) {
+  int tile_width = std::min((int)params.tile_size, detection_mat.cols);
+  int tile_height = std::min((int)params.tile_size, detection_mat.rows);
+  int overlap = (int)params.tile_overlap;
+  std::vector<int> x_starts, y_starts;
+  size_t first = faces.size();
+
+  compute_tile_starts(detection_mat.cols, tile_width, overlap, x_starts);
+  compute_tile_starts(detection_mat.rows, tile_height, overlap, y_starts);
+
+  if (params.inline_tiles && buffer) {
+    for (int y : y_starts) {
+      for (int x : x_starts) {
+        cv::Rect rect(x, y, tile_width, tile_height);
+        run_face_detector(filter, buffer, detection_mat(rect), rect.tl(),
+                          faces);
+      }
+    }
+  } else {
+    /* the tile state is shared with the other callers of the pool */
+    g_mutex_lock(&filter->tile_lock);
+
+    filter->tiles.clear();
+    for (int y : y_starts) {
+      for (int x : x_starts) {
+        filter->tiles.push_back(cv::Rect(x, y, tile_width, tile_height));
+      }
+    }
+    run_tile_jobs(filter, detection_mat, faces);
+
+    g_mutex_unlock(&filter->tile_lock);
+  }
+
+  suppress_overlapping_faces(faces, first);
+}
+
+/* Runs the detector on every rectangle in filter->tiles on the detection
+ * pool and appends the faces in @detection_mat coordinates. The caller holds
+ * tile_lock. */
+static void run_tile_jobs(GstFaceSticker *filter, const cv::Mat &detection_mat,
+                          std::vector<FacialData> &faces) {
+  DetectionPool *pool = get_detection_pool(filter);
+  int concurrency = std::min((int)filter->tiles.size(), pool->size());
+  int openmp_threads =
+      inference_threads_openmp_share(filter->thread_config, concurrency);
+
+  filter->tile_faces.resize(filter->tiles.size());
+  for (std::vector<FacialData> &tile_faces : filter->tile_faces) {
+    tile_faces.clear();
+  }
+
+  if (concurrency > 0) {
+    report_threads(filter, concurrency);
+  }
+
+  pool->run((int)filter->tiles.size(),
+            [filter, &detection_mat, openmp_threads](unsigned char *scratch,
+                                                     int tile) {
+              const cv::Rect &rect = filter->tiles[tile];
+              inference_threads_limit_openmp(openmp_threads);
+              run_face_detector(filter, scratch, detection_mat(rect),
+                                rect.tl(), filter->tile_faces[tile]);
+            });
+
+  for (const std::vector<FacialData> &tile_faces : filter->tile_faces) {
+    faces.insert(faces.end(), tile_faces.begin(), tile_faces.end());
+  }
+}
+
+/* Returns the detection pool, sized by detection_threads within the
+ * n_threads bound and pinned to cpu_affinity. The caller holds tile_lock. */
+static DetectionPool *get_detection_pool(GstFaceSticker *filter) {
+  int n_threads = inference_threads_pool_size(
+      filter->thread_config, (int)filter->detection_threads);
+
+  if (!filter->detection_pool || filter->detection_pool->size() != n_threads) {
+    delete filter->detection_pool;
+    filter->detection_pool =
+        new DetectionPool(n_threads, filter->thread_config.cpus);
+  }
+
+  return filter->detection_pool;
+}
+
+/* Returns the streaming thread's scratch buffer, or NULL when the detector
+ * has to run on the pinned detection pool instead. */
+static unsigned char *get_streaming_scratch(GstFaceSticker *filter) {
+  return filter->thread_config.cpus.empty() ? filter->face_detection_buffer
+                                            : NULL;
+}
+
+/* Runs the detector on the whole of @detection_mat as a single job on the
+ * detection pool, which unlike the streaming thread is pinned to
+ * cpu_affinity, and gives it the whole OpenMP budget. */
+static void run_pooled_detector(GstFaceSticker *filter,
+                                const cv::Mat &detection_mat,
+                                std::vector<FacialData> &faces) {
+  int openmp_threads =
+      inference_threads_openmp_share(filter->thread_config, 1);
+
+  g_mutex_lock(&filter->tile_lock);
+
+  report_threads(filter, 1);
+  get_detection_pool(filter)->run(
+      1, [filter, &detection_mat, &faces, openmp_threads](
+             unsigned char *scratch, int) {
+        inference_threads_limit_openmp(openmp_threads);
+        run_face_detector(filter, scratch, detection_mat, cv::Point(0, 0),
+                          faces);
+      });
+
+  g_mutex_unlock(&filter->tile_lock);
+}
+
+/* Replaces filter->faces with the faces found in crops around them, each
+ * roi_expansion times the face size. Overlapping crops are merged so no
+ * region is searched twice, and the crops run in parallel on the detection
+ * pool. Faces that newly enter the frame are only found by full scans. */
+static void redetect_faces(GstFaceSticker *filter,
+                           const cv::Mat &detection_mat,
+                           const cv::Size &frame_size) {
+  StageTimer timer(filter->stats, STATS_STAGE_DETECT);
+  double scale_x = (double)detection_mat.cols / frame_size.width;
+  double scale_y = (double)detection_mat.rows / frame_size.height;
+  cv::Rect bounds(0, 0, detection_mat.cols, detection_mat.rows);
+  std::vector<FacialData> faces;
+
+  filter->stats->count(STATS_COUNTER_DETECTIONS);
+
+  g_mutex_lock(&filter->tile_lock);
+
+  filter->tiles.clear();
+  for (const FacialData &face : filter->faces) {
+    double width = face.width * scale_x * filter->roi_expansion;
+    double height = face.height * scale_y * filter->roi_expansion;
+    double center_x = (face.x + face.width / 2.0) * scale_x;
+    double center_y = (face.y + face.height / 2.0) * scale_y;
+
+    cv::Rect roi = cv::Rect(cvRound(center_x - width / 2),
+                            cvRound(center_y - height / 2), cvRound(width),
+                            cvRound(height)) &
+                   bounds;
+    if (roi.empty()) {
+      continue;
+    }
+
+    for (size_t i = 0; i < filter->tiles.size();) {
+      if ((filter->tiles[i] & roi).area() > 0) {
+        roi |= filter->tiles[i];
+        filter->tiles.erase(filter->tiles.begin() + i);
+        i = 0;
+      } else {
+        i++;
+      }
+    }
+    filter->tiles.push_back(roi);
+  }
+
+  run_tile_jobs(filter, detection_mat, faces);
+
+  g_mutex_unlock(&filter->tile_lock);
+
+  suppress_overlapping_faces(faces, 0);
+
+  if (detection_mat.size() != frame_size) {
+    for (FacialData &face : faces) {
+      scale_facial_data(face, 1.0 / scale_x, 1.0 / scale_y);
+    }
+  }
+
+  filter->faces.swap(faces);
+}
+
+/* Copies the detection settings for a frame of @frame_size, taken on the
+ * streaming thread. */
+static DetectionParams get_detection_params(GstFaceSticker *filter,
+                                            const cv::Size &frame_size) {
+  DetectionParams params;
+
+  params.frame_size = frame_size;
+  params.tile_size = filter->tile_size;
+  params.tile_overlap = std::min(filter->tile_overlap, filter->tile_size / 2);
+  params.inline_tiles = FALSE;
+  return params;
+}
+
+/* Runs the detector on @detection_mat, whole or in tiles, and appends the
+ * faces above min_confidence to @faces, mapped to a frame of
+ * @params.frame_size. @buffer is the calling thread's scratch buffer, or
+ * NULL to run on the detection pool. */
+static void detect_faces(GstFaceSticker *filter, unsigned char *buffer,
+                         const cv::Mat &detection_mat,
+                         const DetectionParams &params,
+                         std::vector<FacialData> &faces) {
+  StageTimer timer(filter->stats, STATS_STAGE_DETECT);
+  const cv::Size &frame_size = params.frame_size;
+  size_t first = faces.size();
+
+  filter->stats->count(STATS_COUNTER_DETECTIONS);
+
+  if (params.tile_size > 0 &&
+      (detection_mat.cols > (int)params.tile_size ||
+       detection_mat.rows > (int)params.tile_size)) {
+    detect_faces_tiled(filter, buffer, detection_mat, params, faces);
+  } else if (!buffer) {
+    run_pooled_detector(filter, detection_mat, faces);
+  } else {
+    run_face_detector(filter, buffer, detection_mat, cv::Point(0, 0), faces);
+  }
+
+  if (detection_mat.size() != frame_size) {
+    double scale_x = (double)frame_size.width / detection_mat.cols;
+    double scale_y = (double)frame_size.height / detection_mat.rows;
+
+    for (size_t i = first; i < faces.size(); i++) {
+      scale_facial_data(faces[i], scale_x, scale_y);
+    }
+  }
+}
+
+static void render_faces(GstFaceSticker *filter,
+                         const FaceStickerConfig &config, StickerCache *cache,
+                         AtlasCache *atlas_cache, FramePlanes &frame,
+                         GstClockTime pts,
+                         const std::vector<FacialData> &faces) {
+  int sticker_index = sticker_frame(config, pts);
+
+  filter->stats->count(STATS_COUNTER_FACES, faces.size());
+  cache->use_source(config.sticker->source, config.sticker->n_frames);
+  atlas_cache->use_atlas(config.atlas);
+
+  for (size_t i = 0; i < faces.size(); i++) {
+    const FacialData &face = faces[i];
+
+    if (config.effect != GST_FACE_STICKER_EFFECT_STICKER) {
+      /* no markers either, they would point the faces out again */
+      anonymize_face(filter, config.effect, frame, face);
+    } else {
+      {
+        StageTimer timer(filter->stats, STATS_STAGE_DRAW);
+        draw_facial_landmarks(frame.planes[0], face, config.silent);
+      }
+      if (config.atlas) {
+        apply_atlas_stickers(filter, atlas_cache, frame, face);
+      } else {
+        apply_eye_stickers(filter, config, cache, sticker_index, frame, face);
+      }
+    }
+    log_face_data(filter, config.silent, (int)i, face);
+  }
+}
+
+/* Picks the frame of an animated sticker shown at @pts, looping over the
+ * animation at sticker_fps, or the file's own rate when that is 0. */
+static int sticker_frame(const FaceStickerConfig &config, GstClockTime pts) {
+  const StickerAsset &sticker = *config.sticker;
+  gdouble fps = config.sticker_fps;
+
+  if (sticker.n_frames <= 1 || !GST_CLOCK_TIME_IS_VALID(pts)) {
+    return 0;
+  }
+
+  if (fps <= 0) {
+    fps = sticker.fps > 0 ? sticker.fps : STICKER_FALLBACK_FPS;
+  }
+
+  return (guint64)(gst_guint64_to_gdouble(pts) * fps / GST_SECOND) %
+         sticker.n_frames;
+}
+
+/* Detects faces on keyframes and tracks them on the frames in between. A
+ * keyframe is forced whenever the tracker has nothing to track from. */
+static void track_faces(GstFaceSticker *filter, const cv::Mat &detection_mat,
+                        const cv::Size &frame_size, guint keyframe_interval) {
+  if (!filter->face_tracker) {
+    filter->face_tracker = new FaceTracker();
+  }
+
+  gboolean keyframe = filter->frame_count % keyframe_interval == 0;
+  if (!keyframe) {
+    StageTimer timer(filter->stats, STATS_STAGE_TRACK);
+    if (filter->face_tracker->track(detection_mat, frame_size,
+                                    filter->faces)) {
+      return;
+    }
+  }
+
+  filter->faces.clear();
+  detect_faces(filter, get_streaming_scratch(filter), detection_mat,
+               get_detection_params(filter, frame_size), filter->faces);
+  filter->face_tracker->update(detection_mat, frame_size, filter->faces);
+}
+
+/* Returns TRUE when the frame is close enough to the last processed one that
+ * its faces can be reused. Runs on the full frame's luma (or BGR) before any
+ * detection proxy is prepared. */
+static gboolean is_scene_unchanged(GstFaceSticker *filter,
+                                   const FramePlanes &frame) {
+  if (filter->scene_threshold <= 0.0) {
+    return FALSE;
+  }
+
+  double difference = filter->scene_detector->difference(frame.planes[0]);
+
+  if (difference >= 0.0 && difference < filter->scene_threshold &&
+      (filter->scene_max_reuse == 0 ||
+       filter->scene_reuse_count < filter->scene_max_reuse)) {
+    filter->scene_reuse_count++;
+    filter->stats->count(STATS_COUNTER_SCENE_HITS);
+    return TRUE;
+  }
+
+  filter->scene_detector->accept();
+  filter->scene_reuse_count = 0;
+  filter->stats->count(STATS_COUNTER_SCENE_MISSES);
+  return FALSE;
+}
+
+static void process_face_detection(GstFaceSticker *filter, FramePlanes &frame) {
+  if (is_scene_unchanged(filter, frame)) {
+    return;
+  }
+
+  const cv::Mat &detection_mat = prepare_detection_frame(
+      filter, frame, filter->detection_mat, filter->detection_yuv);
+  cv::Size frame_size = frame.planes[0].size();
+  guint keyframe_interval = get_qos_interval(filter, filter->keyframe_interval);
+
+  /* unpinned detection runs right here; the pools set their own limit */
+  inference_threads_limit_openmp(
+      inference_threads_openmp_share(filter->thread_config, 1));
+
+  if (keyframe_interval > 1) {
+    track_faces(filter, detection_mat, frame_size, keyframe_interval);
+  } else if (filter->full_scan_interval > 0 && !filter->faces.empty() &&
+             filter->frame_count % filter->full_scan_interval != 0) {
+    redetect_faces(filter, detection_mat, frame_size);
+  } else {
+    filter->faces.clear();
+    detect_faces(filter, get_streaming_scratch(filter), detection_mat,
+                 get_detection_params(filter, frame_size), filter->faces);
+  }
+}
+
+/* A result is fresh when it was detected on a frame at most max_result_age
+ * milliseconds before @pts. Results without timestamps are always used. */
+static gboolean is_result_fresh(GstFaceSticker *filter, GstClockTime pts) {
+  if (filter->max_result_age == 0 || !GST_CLOCK_TIME_IS_VALID(pts) ||
+      !GST_CLOCK_TIME_IS_VALID(filter->faces_pts)) {
+    return TRUE;
+  }
+
+  if (pts <= filter->faces_pts) {
+    return TRUE;
+  }
+
+  return pts - filter->faces_pts <=
+         (GstClockTime)filter->max_result_age * GST_MSECOND;
+}
+
+/* Returns TRUE when filter->faces holds a result fresh enough for the
+ * frame. */
+static gboolean process_async_face_detection(GstFaceSticker *filter,
+                                             FramePlanes &frame,
+                                             GstClockTime pts) {
+  if (!filter->detection_worker) {
+    /* the shared engine is already a pool of detection threads; fanning
+     * tiles out to this element's pool from each of them would
+     * oversubscribe the CPUs */
+    gboolean inline_tiles = filter->shared_detection;
+    DetectFunc detect = [filter, inline_tiles](
+                            unsigned char *buffer, const cv::Mat &mat,
+                            const DetectionParams &params,
+                            std::vector<FacialData> &faces) {
+      DetectionParams job = params;
+
+      job.inline_tiles = inline_tiles;
+      detect_faces(filter, buffer, mat, job, faces);
+    };
+
+    if (filter->shared_detection) {
+      filter->detection_worker = new SharedDetectionStream(
+          detect, filter->detection_priority, filter->max_in_flight,
+          filter->thread_config);
+    } else {
+      filter->detection_worker =
+          new DetectionWorker(detect, filter->thread_config);
+    }
+
+    filter->stats->set_threads(
+        (guint)filter->detection_worker->n_threads(),
+        (guint)filter->detection_worker->openmp_threads());
+  }
+
+  guint detection_interval =
+      get_qos_interval(filter, filter->detection_interval);
+  if (filter->frame_count % detection_interval == 0) {
+    filter->detection_worker->submit(
+        prepare_detection_frame(filter, frame, filter->detection_mat,
+                                filter->detection_yuv),
+        pts, get_detection_params(filter, frame.planes[0].size()));
+  }
+
+  filter->detection_worker->fetch_latest(filter->faces, filter->faces_pts,
+                                         filter->faces_generation);
+
+  if (!is_result_fresh(filter, pts)) {
+    GST_LOG_OBJECT(filter, "Dropping stale detection result");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Landmark fields of the FACE_ROI_PARAMS structure, in FacialData order */
+static const char *landmark_fields[][2] = {
+    {"left-eye-x", "left-eye-y"},     {"right-eye-x", "right-eye-y"},
+    {"nose-x", "nose-y"},             {"left-mouth-x", "left-mouth-y"},
+    {"right-mouth-x", "right-mouth-y"},
+};
+
+static cv::Point *get_landmarks(FacialData &face, int index) {
+  cv::Point *landmarks[] = {&face.leftEye, &face.rightEye, &face.nose,
+                            &face.leftMouth, &face.rightMouth};
+  return landmarks[index];
+}
+
+/* Attaches one FACE_ROI_TYPE region of interest meta per face, carrying the
+ * confidence and landmarks in a FACE_ROI_PARAMS structure. */
+static void attach_face_metas(GstFaceSticker *filter, GstBuffer *buffer,
+                              const std::vector<FacialData> &faces) {
+  filter->stats->count(STATS_COUNTER_FACES, faces.size());
+
+  for (size_t i = 0; i < faces.size(); i++) {
+    FacialData face = faces[i];
+    int x = std::max(face.x, 0);
+    int y = std::max(face.y, 0);
+
+    GstVideoRegionOfInterestMeta *meta =
+        gst_buffer_add_video_region_of_interest_meta(
+            buffer, FACE_ROI_TYPE, x, y,
+            std::max(face.width - (x - face.x), 0),
+            std::max(face.height - (y - face.y), 0));
+    meta->id = (gint)i;
+
+    GstStructure *params = gst_structure_new(
+        FACE_ROI_PARAMS, "confidence", G_TYPE_INT, face.confidence, "x",
+        G_TYPE_INT, face.x, "y", G_TYPE_INT, face.y, "width", G_TYPE_INT,
+        face.width, "height", G_TYPE_INT, face.height, NULL);
+    for (int l = 0; l < (int)G_N_ELEMENTS(landmark_fields); l++) {
+      const cv::Point *point = get_landmarks(face, l);
+      gst_structure_set(params, landmark_fields[l][0], G_TYPE_INT, point->x,
+                        landmark_fields[l][1], G_TYPE_INT, point->y, NULL);
+    }
+
+    gst_video_region_of_interest_meta_add_param(meta, params);
+  }
+}
+
+/* Rebuilds @faces from the FACE_ROI_TYPE metas of @buffer. */
+static void read_face_metas(GstBuffer *buffer, std::vector<FacialData> &faces) {
+  GstVideoRegionOfInterestMeta *meta;
+  gpointer state = NULL;
+  GQuark face_type = g_quark_from_static_string(FACE_ROI_TYPE);
+
+  faces.clear();
+
+  while ((meta = (GstVideoRegionOfInterestMeta *)
+              gst_buffer_iterate_meta_filtered(
+                  buffer, &state,
+                  GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE))) {
+    if (meta->roi_type != face_type) {
+      continue;
+    }
+
+    GstStructure *params =
+        gst_video_region_of_interest_meta_get_param(meta, FACE_ROI_PARAMS);
+    FacialData face = {};
+
+    face.x = (int)meta->x;
+    face.y = (int)meta->y;
+    face.width = (int)meta->w;
+    face.height = (int)meta->h;
+
+    if (params) {
+      gst_structure_get_int(params, "confidence", &face.confidence);
+      gst_structure_get_int(params, "x", &face.x);
+      gst_structure_get_int(params, "y", &face.y);
+      gst_structure_get_int(params, "width", &face.width);
+      gst_structure_get_int(params, "height", &face.height);
+
+      for (int l = 0; l < (int)G_N_ELEMENTS(landmark_fields); l++) {
+        cv::Point *point = get_landmarks(face, l);
+        gst_structure_get_int(params, landmark_fields[l][0], &point->x);
+        gst_structure_get_int(params, landmark_fields[l][1], &point->y);
+      }
+    }
+
+    faces.push_back(face);
+  }
+}
+
+/* Attaches the eye stickers of @faces as one overlay composition. Only the
+ * sticker images are handed over; boxes and landmarks are not drawn. */
+static void attach_sticker_overlay(GstFaceSticker *filter,
+                                   const FaceStickerConfig &config,
+                                   GstBuffer *buffer,
+                                   const std::vector<FacialData> &faces) {
+  GstVideoOverlayComposition *composition = NULL;
+  int frame_width = GST_VIDEO_INFO_WIDTH(&filter->in_info);
+  int frame_height = GST_VIDEO_INFO_HEIGHT(&filter->in_info);
+
+  int sticker_index = sticker_frame(config, GST_BUFFER_PTS(buffer));
+
+  filter->stats->count(STATS_COUNTER_FACES, faces.size());
+  filter->overlay_cache->use_source(config.sticker->source,
+                                    config.sticker->n_frames);
+  filter->overlay_atlas_cache->use_atlas(config.atlas);
+
+  for (size_t i = 0; i < faces.size(); i++) {
+    const FacialData &face = faces[i];
+    const StickerSprite *sprite;
+
+    if (config.atlas) {
+      const std::vector<AtlasPlacement> *placements;
+      {
+        StageTimer timer(filter->stats, STATS_STAGE_RESIZE);
+        placements = &filter->overlay_atlas_cache->place(face, 1, 1);
+      }
+      log_face_data(filter, config.silent, (int)i, face);
+
+      /* rectangles may reach past the frame, the blending clips them */
+      for (const AtlasPlacement &placement : *placements) {
+        add_overlay_rectangle(
+            filter, &composition, *placement.sprite,
+            cv::Rect(placement.origin, placement.sprite->color[0].size()));
+      }
+      continue;
+    }
+
+    {
+      StageTimer timer(filter->stats, STATS_STAGE_RESIZE);
+      sprite = filter->overlay_cache->lookup(
+          cv::Size(face.width * config.eye_img_scale,
+                   face.height * config.eye_img_scale),
+          sticker_index);
+    }
+    log_face_data(filter, config.silent, (int)i, face);
+    if (!sprite) {
+      continue;
+    }
+
+    const cv::Point *eyes[] = {&face.leftEye, &face.rightEye};
+
+    for (const cv::Point *eye : eyes) {
+      add_overlay_rectangle(filter, &composition, *sprite,
+                            calculate_eye_roi(*eye, sprite->color[0],
+                                              frame_width, frame_height));
+    }
+  }
+
+  if (composition) {
+    gst_buffer_add_video_overlay_composition_meta(buffer, composition);
+    gst_video_overlay_composition_unref(composition);
+  }
+}
+
+/* Adds @sprite at @roi to *@composition, creating it on the first call. */
+static void add_overlay_rectangle(GstFaceSticker *filter,
+                                  GstVideoOverlayComposition **composition,
+                                  const StickerSprite &sprite,
+                                  const cv::Rect &roi) {
+  GstBuffer *pixels = get_overlay_pixels(filter, sprite.color[0]);
+  GstVideoOverlayRectangle *rectangle = gst_video_overlay_rectangle_new_raw(
+      pixels, roi.x, roi.y, roi.width, roi.height,
+      GST_VIDEO_OVERLAY_FORMAT_FLAG_PREMULTIPLIED_ALPHA);
+
+  if (!*composition) {
+    *composition = gst_video_overlay_composition_new(rectangle);
+  } else {
+    gst_video_overlay_composition_add_rectangle(*composition, rectangle);
+  }
+  gst_video_overlay_rectangle_unref(rectangle);
+}
+
+static void release_overlay_pixels(gpointer data) { delete (cv::Mat *)data; }
+
+/* Returns a buffer sharing the memory of the cached BGRA sprite @pixels. The
+ * wrappers are kept per sprite so that repeated sizes reuse them; a sprite's
+ * memory stays alive as long as its wrapper, so the address is never reused
+ * for another sprite while it is in the map. */
+static GstBuffer *get_overlay_pixels(GstFaceSticker *filter,
+                                     const cv::Mat &pixels) {
+  auto it = filter->overlay_pixels.find(pixels.data);
+  if (it != filter->overlay_pixels.end()) {
+    return it->second;
+  }
+
+  if (filter->overlay_pixels.size() >= OVERLAY_PIXELS_MAX) {
+    clear_overlay_pixels(filter);
+  }
+
+  cv::Mat *ref = new cv::Mat(pixels);
+  gsize size = ref->step[0] * ref->rows;
+  gsize offset[GST_VIDEO_MAX_PLANES] = {0};
+  gint stride[GST_VIDEO_MAX_PLANES] = {(gint)ref->step[0]};
+
+  GstBuffer *buffer =
+      gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, ref->data, size,
+                                  0, size, ref, release_overlay_pixels);
+  gst_buffer_add_video_meta_full(
+      buffer, GST_VIDEO_FRAME_FLAG_NONE,
+      GST_VIDEO_OVERLAY_COMPOSITION_FORMAT_RGB, ref->cols, ref->rows, 1,
+      offset, stride);
+
+  filter->overlay_pixels[pixels.data] = buffer;
+  return buffer;
+}
+
+static void clear_overlay_pixels(GstFaceSticker *filter) {
+  for (auto &entry : filter->overlay_pixels) {
+    gst_buffer_unref(entry.second);
+  }
+  filter->overlay_pixels.clear();
+}
+
+/* Wraps every plane of @frame in a cv::Mat that shares the mapped memory. */
+static void wrap_video_frame(GstVideoFrame *frame, FramePlanes &planes) {
+  const GstVideoFormatInfo *finfo = frame->info.finfo;
+
+  planes.format = GST_VIDEO_FRAME_FORMAT(frame);
+  planes.n_planes = GST_VIDEO_FRAME_N_PLANES(frame);
+
+  for (guint comp = 0; comp < GST_VIDEO_FRAME_N_COMPONENTS(frame); comp++) {
+    guint plane = GST_VIDEO_FORMAT_INFO_PLANE(finfo, comp);
+
+    /* planes holding several components are described by their first */
+    if (!planes.planes[plane].empty()) {
+      continue;
+    }
+
+    planes.planes[plane] =
+        cv::Mat(GST_VIDEO_FRAME_COMP_HEIGHT(frame, comp),
+                GST_VIDEO_FRAME_COMP_WIDTH(frame, comp),
+                CV_8UC(GST_VIDEO_FRAME_COMP_PSTRIDE(frame, comp)),
+                GST_VIDEO_FRAME_PLANE_DATA(frame, plane),
+                GST_VIDEO_FRAME_PLANE_STRIDE(frame, plane));
+    planes.x_shift[plane] = GST_VIDEO_FORMAT_INFO_W_SUB(finfo, comp);
+    planes.y_shift[plane] = GST_VIDEO_FORMAT_INFO_H_SUB(finfo, comp);
+  }
+}
+
+/* Starts the loader thread on first use. Returns TRUE when streaming, when
+ * loads must not block the caller. */
+static gboolean get_sticker_loader(GstFaceSticker *filter) {
+  gboolean streaming;
+
+  if (!filter->sticker_loader) {
+    filter->sticker_loader = new StickerLoader(
+        [filter](std::shared_ptr<const StickerAsset> asset) {
+          publish_sticker(filter, std::move(asset));
+        },
+        [filter](const std::string &path,
+                 std::shared_ptr<const StickerAtlas> atlas,
+                 const GError *error) {
+          publish_atlas(filter, path, std::move(atlas), error);
+        });
+  }
+
+  GST_OBJECT_LOCK(filter);
+  streaming = GST_STATE(filter) >= GST_STATE_PAUSED;
+  GST_OBJECT_UNLOCK(filter);
+
+  return streaming;
+}
+
+/* Queues eye_img_path for decoding. While streaming the new sticker
+ * replaces the old one whenever it is ready; before that, wait so that the
+ * first frame already has it. */
+static void load_sticker(GstFaceSticker *filter) {
+  gboolean streaming = get_sticker_loader(filter);
+
+  filter->sticker_loader->load(filter->eye_img_path, filter->sprite_columns,
+                               filter->sprite_rows, !streaming);
+}
+
+/* Publishes a sticker decoded by the loader thread. The streaming thread
+ * picks it up with the next frame's snapshot. */
+static void publish_sticker(GstFaceSticker *filter,
+                            std::shared_ptr<const StickerAsset> asset) {
+  if (asset->source.empty() && !asset->path.empty()) {
+    GST_WARNING_OBJECT(filter, "Failed to load eye image from %s",
+                       asset->path.c_str());
+  } else if (!asset->path.empty()) {
+    GST_DEBUG_OBJECT(filter, "Loaded eye image from %s, %d frame(s)",
+                     asset->path.c_str(), asset->n_frames);
+  }
+
+  filter->config->update([&asset](FaceStickerConfig &config) {
+    config.sticker = std::move(asset);
+  });
+}
+
+/* Same as load_sticker(), for atlas_path. */
+static void load_atlas(GstFaceSticker *filter) {
+  gboolean streaming = get_sticker_loader(filter);
+
+  filter->sticker_loader->load_atlas(filter->atlas_path, !streaming);
+}
+
+/* Publishes an atlas loaded by the loader thread, or drops the current one
+ * when @atlas is NULL. */
+static void publish_atlas(GstFaceSticker *filter, const std::string &path,
+                          std::shared_ptr<const StickerAtlas> atlas,
+                          const GError *error) {
+  if (error) {
+    GST_WARNING_OBJECT(filter, "Failed to load sticker atlas %s: %s",
+                       path.c_str(), error->message);
+  } else if (atlas) {
+    GST_DEBUG_OBJECT(filter, "Loaded sticker atlas %s with %d sprites",
+                     path.c_str(), (int)atlas->sprites.size());
+  }
+
+  filter->config->update([&atlas](FaceStickerConfig &config) {
+    config.atlas = std::move(atlas);
+  });
+}
+
+/* Asks downstream once per caps, like textoverlay, whether it blends
+ * overlay composition meta. */
+static void check_overlay_support(GstFaceSticker *filter) {
+  GstPad *srcpad = GST_BASE_TRANSFORM_SRC_PAD(filter);
+  gboolean supported = FALSE;
+
+  if (filter->overlay_checked) {
+    return;
+  }
+  filter->overlay_checked = TRUE;
+
+  GstCaps *caps = gst_pad_get_current_caps(srcpad);
+  if (caps) {
+    GstQuery *query = gst_query_new_allocation(caps, FALSE);
+
+    if (gst_pad_peer_query(srcpad, query)) {
+      supported = gst_query_find_allocation_meta(
+          query, GST_VIDEO_OVERLAY_COMPOSITION_META_API_TYPE, NULL);
+    }
+
+    gst_query_unref(query);
+    gst_caps_unref(caps);
+  }
+
+  if (!supported) {
+    GST_WARNING_OBJECT(filter, "Downstream does not handle overlay "
+                               "composition meta, drawing into the frames");
+  }
+  filter->overlay_supported = supported;
+}
+
+/* Anonymization has to change the pixels themselves, so it always draws
+ * into the frame, whatever overlay_composition says. So do stickers when
+ * downstream would drop the meta. */
+static gboolean uses_overlay(GstFaceSticker *filter,
+                             const FaceStickerConfig &config) {
+  return config.overlay_composition && filter->overlay_supported &&
+         config.effect == GST_FACE_STICKER_EFFECT_STICKER;
+}
+
+/* Maps @buffer and wraps its planes. Detect and overlay output only read
+ * the pixels, so the memory stays shared with upstream even when the buffer
+ * itself had to be made writable for the metas. */
+static gboolean map_frame(GstFaceSticker *filter,
+                          const FaceStickerConfig &config, GstBuffer *buffer,
+                          GstVideoFrame *frame, FramePlanes &planes) {
+  StageTimer timer(filter->stats, STATS_STAGE_MAP);
+  int map_flags = GST_MAP_READ | (GstMapFlags)GST_VIDEO_FRAME_MAP_FLAG_NO_REF;
+
+  if (!gst_base_transform_is_passthrough(GST_BASE_TRANSFORM(filter)) &&
+      config.mode != GST_FACE_STICKER_MODE_DETECT &&
+      !uses_overlay(filter, config)) {
+    map_flags |= GST_MAP_WRITE;
+  }
+
+  if (!gst_video_frame_map(frame, &filter->in_info, buffer,
+                           (GstMapFlags)map_flags)) {
+    GST_ELEMENT_ERROR(filter, STREAM, FAILED, (NULL),
+                      ("Failed to map video frame"));
+    return FALSE;
+  }
+
+  wrap_video_frame(frame, planes);
+  return TRUE;
+}
+
+/* Returns a reference to the meta_src pad, or NULL when it has not been
+ * requested. */
+static GstPad *get_meta_pad(GstFaceSticker *filter) {
+  GstPad *pad = NULL;
+
+  GST_OBJECT_LOCK(filter);
+  if (filter->meta_pad) {
+    pad = (GstPad *)gst_object_ref(filter->meta_pad);
+  }
+  GST_OBJECT_UNLOCK(filter);
+
+  return pad;
+}
+
+/* Packs the faces of @frame in meta_format, timestamped like the frame. */
+static GstBuffer *make_meta_record(GstFaceSticker *filter, GstBuffer *frame,
+                                   const std::vector<FacialData> &faces) {
+  GstClockTime pts = GST_BUFFER_PTS(frame);
+  GstBuffer *record;
+
+  if (filter->meta_format == GST_FACE_STICKER_META_FORMAT_JSON) {
+    GString *json = g_string_sized_new(64 + faces.size() * 128);
+    face_trace_format_json(pts, faces, json);
+
+    gsize size = json->len;
+    record = gst_buffer_new_wrapped(g_string_free(json, FALSE), size);
+  } else {
+    GstMapInfo map;
+
+    record = gst_buffer_new_allocate(
+        NULL, face_trace_record_size(faces.size()), NULL);
+    gst_buffer_map(record, &map, GST_MAP_WRITE);
+    face_trace_pack_record(pts, faces, map.data);
+    gst_buffer_unmap(record, &map);
+  }
+
+  GST_BUFFER_PTS(record) = pts;
+  GST_BUFFER_DTS(record) = GST_BUFFER_DTS(frame);
+  GST_BUFFER_DURATION(record) = GST_BUFFER_DURATION(frame);
+  return record;
+}
+
+/* Starts the stream on @pad before its first record: stream-start, the caps
+ * for meta_format and the video segment. Sticky events are dropped when the
+ * pad is deactivated, so this runs again after a restart. */
+static void start_meta_pad(GstFaceSticker *filter, GstPad *pad) {
+  gchar *stream_id =
+      gst_pad_create_stream_id(pad, GST_ELEMENT(filter), "meta");
+  gst_pad_push_event(pad, gst_event_new_stream_start(stream_id));
+  g_free(stream_id);
+
+  GstCaps *caps = gst_caps_new_simple(
+      FACE_STICKER_META_CAPS, "format", G_TYPE_STRING,
+      filter->meta_format == GST_FACE_STICKER_META_FORMAT_JSON ? "json"
+                                                               : "binary",
+      NULL);
+  gst_pad_push_event(pad, gst_event_new_caps(caps));
+  gst_caps_unref(caps);
+
+  gst_pad_push_event(
+      pad, gst_event_new_segment(&GST_BASE_TRANSFORM(filter)->segment));
+}
+
+/* Pushes @record on @pad. Records are a side channel: an unlinked or
+ * failing meta_src never stops the video. */
+static void push_meta_record(GstFaceSticker *filter, GstPad *pad,
+                             GstBuffer *record) {
+  if (!gst_pad_has_current_caps(pad)) {
+    start_meta_pad(filter, pad);
+  }
+
+  GstFlowReturn ret = gst_pad_push(pad, record);
+  if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED) {
+    GST_DEBUG_OBJECT(filter, "Pushing detection record: %s",
+                     gst_flow_get_name(ret));
+  }
+}
+
+/* Forwards a serialized or flush event of the video stream to meta_src. */
+static void push_meta_event(GstFaceSticker *filter, GstEvent *event) {
+  GstPad *pad = get_meta_pad(filter);
+
+  if (!pad) {
+    gst_event_unref(event);
+    return;
+  }
+
+  if (GST_EVENT_IS_SERIALIZED(event) && !gst_pad_has_current_caps(pad)) {
+    start_meta_pad(filter, pad);
+  }
+  gst_pad_push_event(pad, event);
+  gst_object_unref(pad);
+}
+
+static void emit_meta_record(GstFaceSticker *filter, GstBuffer *frame,
+                             const std::vector<FacialData> &faces) {
+  GstPad *pad = get_meta_pad(filter);
+
+  if (pad) {
+    push_meta_record(filter, pad, make_meta_record(filter, frame, faces));
+    gst_object_unref(pad);
+  }
+}
+
+/* Frames of the parallel queue finish out of order, so their records ride
+ * along on the frame until it is pushed. */
+static void attach_meta_record(GstFaceSticker *filter, GstBuffer *frame,
+                               const std::vector<FacialData> &faces) {
+  GstPad *pad = get_meta_pad(filter);
+
+  if (pad) {
+    gst_mini_object_set_qdata(GST_MINI_OBJECT(frame), meta_record_quark,
+                              make_meta_record(filter, frame, faces),
+                              (GDestroyNotify)gst_buffer_unref);
+    gst_object_unref(pad);
+  }
+}
+
+static void push_attached_meta_record(GstFaceSticker *filter,
+                                      GstBuffer *frame) {
+  GstBuffer *record = (GstBuffer *)gst_mini_object_steal_qdata(
+      GST_MINI_OBJECT(frame), meta_record_quark);
+  if (!record) {
+    return;
+  }
+
+  /* the pad may have been released since */
+  GstPad *pad = get_meta_pad(filter);
+  if (!pad) {
+    gst_buffer_unref(record);
+    return;
+  }
+
+  push_meta_record(filter, pad, record);
+  gst_object_unref(pad);
+}
+
+/* GstBaseTransform vmethod implementations */
+
+/* When parallel_frames is in effect, moves the buffer the base class kept
+ * for generate_output() to the parallel frame queue instead. The base class
+ * still renegotiates and drops late buffers for QoS first. */
+static GstFlowReturn
+gst_face_sticker_submit_input_buffer(GstBaseTransform *trans,
+                                     gboolean is_discont, GstBuffer *input) {
+  GstFaceSticker *filter = GST_FACESTICKER(trans);
+  GstFlowReturn ret = GST_BASE_TRANSFORM_CLASS(parent_class)
+                          ->submit_input_buffer(trans, is_discont, input);
+
+  if (ret != GST_FLOW_OK || !filter->parallel_active ||
+      !trans->queued_buf) {
+    return ret;
+  }
+
+  GstBuffer *buffer = trans->queued_buf;
+  trans->queued_buf = NULL;
+
+  /* frames are processed out of order, so the controlled properties are
+   * brought to each one's time here, in stream order */
+  if (GST_CLOCK_TIME_IS_VALID(GST_BUFFER_TIMESTAMP(buffer))) {
+    gst_object_sync_values(GST_OBJECT(filter), GST_BUFFER_TIMESTAMP(buffer));
+  }
+
+  if (!filter->frame_queue) {
+    create_frame_queue(filter);
+  }
+
+  filter->frame_queue->submit(gst_buffer_make_writable(buffer));
+  return GST_FLOW_OK;
+}
+
+/* Hands out the finished frames at the head of the parallel queue, waiting
+ * only when the window is full. Called until it returns no buffer. */
+static GstFlowReturn gst_face_sticker_generate_output(GstBaseTransform *trans,
+                                                      GstBuffer **outbuf) {
+  GstFaceSticker *filter = GST_FACESTICKER(trans);
+  GstFlowReturn ret;
+
+  if (!filter->parallel_active) {
+    return GST_BASE_TRANSFORM_CLASS(parent_class)
+        ->generate_output(trans, outbuf);
+  }
+
+  *outbuf = NULL;
+  if (!filter->frame_queue) {
+    return GST_FLOW_OK;
+  }
+
+  GstBuffer *buffer = filter->frame_queue->pop(false, ret);
+  if (ret != GST_FLOW_OK) {
+    gst_clear_buffer(&buffer);
+    return ret;
+  }
+
+  if (buffer) {
+    filter->frame_count++;
+    push_attached_meta_record(filter, buffer);
+    post_stats(filter);
+  }
+
+  *outbuf = buffer;
+  return GST_FLOW_OK;
+}
+
+/* Pushes every frame still in the parallel queue, in order. */
+static void drain_frame_queue(GstFaceSticker *filter) {
+  GstPad *srcpad = GST_BASE_TRANSFORM_SRC_PAD(filter);
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+
+  while ((buffer = filter->frame_queue->pop(true, ret))) {
+    if (ret == GST_FLOW_OK) {
+      filter->frame_count++;
+      push_attached_meta_record(filter, buffer);
+      ret = gst_pad_push(srcpad, buffer);
+    } else {
+      gst_buffer_unref(buffer);
+    }
+
+    if (ret != GST_FLOW_OK) {
+      GST_DEBUG_OBJECT(filter, "Draining frame: %s", gst_flow_get_name(ret));
+    }
+  }
+}
+
+/* Starts one thread per inference thread, at most parallel_frames, each with
+ * its own detection proxy and sticker cache. */
+static void create_frame_queue(GstFaceSticker *filter) {
+  int n_threads =
+      std::min(inference_threads_pool_size(filter->thread_config, 0),
+               (int)filter->parallel_frames);
+  int openmp_threads =
+      inference_threads_openmp_share(filter->thread_config, n_threads);
+
+  filter->frame_workers.resize(n_threads);
+  for (FrameWorkerState &state : filter->frame_workers) {
+    state.sticker_cache = new StickerCache();
+    state.sticker_cache->set_format(GST_VIDEO_INFO_FORMAT(&filter->in_info));
+    state.atlas_cache = new AtlasCache();
+    state.atlas_cache->set_format(GST_VIDEO_INFO_FORMAT(&filter->in_info));
+  }
+
+  filter->frame_queue = new ParallelFrameQueue(
+      n_threads, (int)filter->parallel_frames, filter->thread_config.cpus,
+      [filter, openmp_threads](int worker, unsigned char *scratch,
+                               GstBuffer *buffer) {
+        inference_threads_limit_openmp(openmp_threads);
+        return process_parallel_frame(filter, worker, scratch, buffer);
+      });
+
+  report_threads(filter, n_threads);
+}
+
+static void destroy_frame_queue(GstFaceSticker *filter) {
+  delete filter->frame_queue;
+  filter->frame_queue = NULL;
+
+  for (FrameWorkerState &state : filter->frame_workers) {
+    delete state.sticker_cache;
+    delete state.atlas_cache;
+  }
+  filter->frame_workers.clear();
+}
+
+/* Detects and draws on one frame on a thread of the parallel queue. Every
+ * frame gets a full detection: tracking, scene gating, re-detection around
+ * previous faces and QoS adaptation depend on the frame before and are not
+ * used. */
+static GstFlowReturn process_parallel_frame(GstFaceSticker *filter,
+                                            int worker,
+                                            unsigned char *scratch,
+                                            GstBuffer *buffer) {
+  FrameWorkerState &state = filter->frame_workers[worker];
+  std::shared_ptr<const FaceStickerConfig> config = filter->config->load();
+  GstVideoFrame frame;
+  FramePlanes planes;
+
+  if (!map_frame(filter, *config, buffer, &frame, planes)) {
+    return GST_FLOW_ERROR;
+  }
+
+  if (config->mode == GST_FACE_STICKER_MODE_RENDER) {
+    read_face_metas(buffer, state.faces);
+  } else {
+    /* every inference thread already runs a frame of its own */
+    DetectionParams params =
+        get_detection_params(filter, planes.planes[0].size());
+    params.inline_tiles = TRUE;
+
+    state.faces.clear();
+    detect_faces(filter, scratch,
+                 prepare_detection_frame(filter, planes, state.detection_mat,
+                                         state.detection_yuv),
+                 params, state.faces);
+  }
+  attach_meta_record(filter, buffer, state.faces);
+
+  if (config->mode == GST_FACE_STICKER_MODE_DETECT) {
+    attach_face_metas(filter, buffer, state.faces);
+  } else {
+    render_faces(filter, *config, state.sticker_cache, state.atlas_cache,
+                 planes, GST_BUFFER_PTS(buffer), state.faces);
+  }
+
+  gst_video_frame_unmap(&frame);
+
+  filter->stats->count(STATS_COUNTER_FRAMES);
+  return GST_FLOW_OK;
+}
+
+/* this function does the actual processing
+ */
+static GstFlowReturn gst_face_sticker_transform_ip(GstBaseTransform *base,
+                                                   GstBuffer *outbuf) {
+  GstFaceSticker *filter = GST_FACESTICKER(base);
+  GstVideoFrame frame;
+  FramePlanes planes;
+
+  if (GST_CLOCK_TIME_IS_VALID(GST_BUFFER_TIMESTAMP(outbuf))) {
+    gst_object_sync_values(GST_OBJECT(filter), GST_BUFFER_TIMESTAMP(outbuf));
+  }
+
+  /* one snapshot for the whole frame, however the properties change */
+  std::shared_ptr<const FaceStickerConfig> config = filter->config->load();
+
+  if (config->overlay_composition) {
+    check_overlay_support(filter);
+  }
+
+  if (!map_frame(filter, *config, outbuf, &frame, planes)) {
     return GST_FLOW_ERROR;
   }
 
-  cv::Mat frame_mat(filter->in_info.height, filter->in_info.width, CV_8UC3,
-                    frame.data[0]);
+  update_qos_level(filter);
+
+  gboolean have_faces = TRUE;
+  if (config->mode == GST_FACE_STICKER_MODE_RENDER) {
+    read_face_metas(outbuf, filter->faces);
+  } else if (filter->trace_reader) {
+    if (!filter->trace_reader->lookup(GST_BUFFER_PTS(outbuf),
+                                      filter->frame_count, filter->faces)) {
+      GST_LOG_OBJECT(filter, "No trace record for %" GST_TIME_FORMAT,
+                     GST_TIME_ARGS(GST_BUFFER_PTS(outbuf)));
+    }
+  } else if (filter->async_detection) {
+    have_faces =
+        process_async_face_detection(filter, planes, GST_BUFFER_PTS(outbuf));
+  } else {
+    process_face_detection(filter, planes);
+  }
 
-  process_face_detection(filter, frame_mat);
+  static const std::vector<FacialData> no_faces;
+  if (filter->trace_writer &&
+      !filter->trace_writer->write(GST_BUFFER_PTS(outbuf),
+                                   have_faces ? filter->faces : no_faces)) {
+    GST_WARNING_OBJECT(filter, "Failed to append to trace %s",
+                       filter->trace_path);
+  }
+  emit_meta_record(filter, outbuf, have_faces ? filter->faces : no_faces);
+
+  /* a late result drops the stickers, but anonymization keeps covering the
+   * last known faces instead of revealing them until detection catches up */
+  if (have_faces || (config->mode != GST_FACE_STICKER_MODE_DETECT &&
+                     config->effect != GST_FACE_STICKER_EFFECT_STICKER)) {
+    if (config->mode == GST_FACE_STICKER_MODE_DETECT) {
+      attach_face_metas(filter, outbuf, filter->faces);
+    } else if (uses_overlay(filter, *config)) {
+      attach_sticker_overlay(filter, *config, outbuf, filter->faces);
+    } else {
+      render_faces(filter, *config, filter->sticker_cache,
+                   filter->atlas_cache, planes, GST_BUFFER_PTS(outbuf),
+                   filter->faces);
+    }
+  }
+  filter->frame_count++;
 
   gst_video_frame_unmap(&frame);
 
+  filter->stats->count(STATS_COUNTER_FRAMES);
+  post_stats(filter);
+
   return GST_FLOW_OK;
 }
 
+/* Posts the statistics as an element message once stats_interval has
+ * passed since the previous one. */
+static void post_stats(GstFaceSticker *filter) {
+  if (filter->stats_interval == 0) {
+    return;
+  }
+
+  GstClockTime now = gst_util_get_timestamp();
+  if (GST_CLOCK_TIME_IS_VALID(filter->last_stats_post) &&
+      now - filter->last_stats_post <
+          (GstClockTime)filter->stats_interval * GST_MSECOND) {
+    return;
+  }
+  filter->last_stats_post = now;
+
+  gst_element_post_message(
+      GST_ELEMENT(filter),
+      gst_message_new_element(GST_OBJECT(filter),
+                              filter->stats->to_structure()));
+}
+
 /* entry point to initialize the plug-in
  * initialize the plug-in itself
  * register the element factories and other features
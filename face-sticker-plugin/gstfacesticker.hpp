@@ -28,6 +28,11 @@
 #include <gst/gst.h>
 #include <gst/video/video-info.h>
 #include <opencv2/core/mat.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "facialdata.hpp"
+#include "inferencethreads.hpp"
 
 #define GST_API_VERSION "1.0"
 #define GST_LICENSE "LGPL"
@@ -38,12 +43,139 @@
 
 #define DETECT_BUFFER_SIZE 0x9000
 
+// Row alignment requested for frame planes, wide enough for AVX2
+#define FRAME_ALIGNMENT 32
+
 // Default values for properties
 #define DEFAULT_EYE_IMG_SCALE 1.0f
 #define DEFAULT_MIN_CONFIDENCE 50
+#define DEFAULT_ASYNC_DETECTION FALSE
+#define DEFAULT_DETECTION_INTERVAL 1
+#define DEFAULT_MAX_RESULT_AGE 500
+#define DEFAULT_DETECTION_WIDTH 0
+#define DEFAULT_KEYFRAME_INTERVAL 1
+#define DEFAULT_TILE_SIZE 0
+#define DEFAULT_TILE_OVERLAP 64
+#define DEFAULT_DETECTION_THREADS 0
+#define DEFAULT_SHARED_DETECTION FALSE
+#define DEFAULT_DETECTION_PRIORITY 1
+#define DEFAULT_MAX_IN_FLIGHT 1
+#define DEFAULT_STATS_INTERVAL 0
+#define DEFAULT_ADAPTIVE_QOS FALSE
+#define DEFAULT_SCENE_THRESHOLD 0.0
+#define DEFAULT_SCENE_MAX_REUSE 30
+#define DEFAULT_FULL_SCAN_INTERVAL 0
+#define DEFAULT_ROI_EXPANSION 2.0
+#define DEFAULT_MODE GST_FACE_STICKER_MODE_FULL
+#define DEFAULT_OVERLAY_COMPOSITION FALSE
+#define DEFAULT_TRACE_MODE GST_FACE_STICKER_TRACE_NONE
+#define DEFAULT_DETECTOR GST_FACE_STICKER_DETECTOR_CNN
+#define DEFAULT_N_THREADS 0
+#define DEFAULT_PARALLEL_FRAMES 0
+#define DEFAULT_EFFECT GST_FACE_STICKER_EFFECT_STICKER
+#define DEFAULT_STICKER_FPS 0.0
+#define DEFAULT_SPRITE_COLUMNS 1
+#define DEFAULT_SPRITE_ROWS 1
+#define DEFAULT_META_FORMAT GST_FACE_STICKER_META_FORMAT_BINARY
+
+// Playback rate of animated stickers whose file carries none, e.g. sheets
+#define STICKER_FALLBACK_FPS 10.0
+
+// Load shedding driven by downstream QoS: each level doubles the detection
+// interval and halves the detection width, down to QOS_MIN_DETECTION_WIDTH.
+// The level moves by at most one step every QOS_SETTLE_FRAMES frames.
+#define QOS_MAX_LEVEL 3
+#define QOS_SETTLE_FRAMES 30
+#define QOS_OVERLOAD_PROPORTION 1.1
+#define QOS_RECOVER_PROPORTION 0.8
+#define QOS_MIN_DETECTION_WIDTH 160
+
+// Anonymization strength, relative to the larger side of the face box: the
+// mosaic has about ANONYMIZE_PIXELATE_CELLS cells across, the box blur a
+// radius of 1/ANONYMIZE_BLUR_DIVISOR, applied ANONYMIZE_BLUR_PASSES times
+#define ANONYMIZE_PIXELATE_CELLS 8
+#define ANONYMIZE_BLUR_DIVISOR 6
+#define ANONYMIZE_BLUR_PASSES 3
+
+// Region of interest meta attached per face in detect mode
+#define FACE_ROI_TYPE "face"
+#define FACE_ROI_PARAMS "face-landmarks"
+
+// Overlap above which tiled detections are merged into one face
+#define NMS_IOU_THRESHOLD 0.3
+#define NMS_CONTAINMENT_THRESHOLD 0.6
+
+class AsyncDetector;
+class AtlasCache;
+class ConfigStore;
+class DetectionPool;
+class FaceDetector;
+class FaceTraceReader;
+class FaceTraceWriter;
+class FaceTracker;
+class ParallelFrameQueue;
+class SceneChangeDetector;
+class StageStats;
+class StickerCache;
+class StickerLoader;
+
+/* State owned by one thread of the parallel frame queue. */
+typedef struct {
+  cv::Mat detection_mat;
+  cv::Mat detection_yuv;
+  std::vector<FacialData> faces;
+  StickerCache *sticker_cache;
+  AtlasCache *atlas_cache;
+} FrameWorkerState;
 
 G_BEGIN_DECLS
 
+typedef enum {
+  GST_FACE_STICKER_MODE_FULL,
+  GST_FACE_STICKER_MODE_DETECT,
+  GST_FACE_STICKER_MODE_RENDER,
+} GstFaceStickerMode;
+
+#define GST_TYPE_FACE_STICKER_MODE (gst_face_sticker_mode_get_type())
+GType gst_face_sticker_mode_get_type(void);
+
+typedef enum {
+  GST_FACE_STICKER_TRACE_NONE,
+  GST_FACE_STICKER_TRACE_RECORD,
+  GST_FACE_STICKER_TRACE_REPLAY,
+} GstFaceStickerTraceMode;
+
+#define GST_TYPE_FACE_STICKER_TRACE_MODE                                      \
+  (gst_face_sticker_trace_mode_get_type())
+GType gst_face_sticker_trace_mode_get_type(void);
+
+typedef enum {
+  GST_FACE_STICKER_DETECTOR_CNN,
+  GST_FACE_STICKER_DETECTOR_YUNET,
+  GST_FACE_STICKER_DETECTOR_CASCADE,
+} GstFaceStickerDetector;
+
+#define GST_TYPE_FACE_STICKER_DETECTOR (gst_face_sticker_detector_get_type())
+GType gst_face_sticker_detector_get_type(void);
+
+typedef enum {
+  GST_FACE_STICKER_EFFECT_STICKER,
+  GST_FACE_STICKER_EFFECT_PIXELATE,
+  GST_FACE_STICKER_EFFECT_BLUR,
+} GstFaceStickerEffect;
+
+#define GST_TYPE_FACE_STICKER_EFFECT (gst_face_sticker_effect_get_type())
+GType gst_face_sticker_effect_get_type(void);
+
+typedef enum {
+  GST_FACE_STICKER_META_FORMAT_BINARY,
+  GST_FACE_STICKER_META_FORMAT_JSON,
+} GstFaceStickerMetaFormat;
+
+#define GST_TYPE_FACE_STICKER_META_FORMAT                                     \
+  (gst_face_sticker_meta_format_get_type())
+GType gst_face_sticker_meta_format_get_type(void);
+
 #define GST_TYPE_FACESTICKER (gst_face_sticker_get_type())
 G_DECLARE_FINAL_TYPE(GstFaceSticker, gst_face_sticker, GST, FACESTICKER,
                      GstBaseTransform)
@@ -51,32 +183,113 @@ G_DECLARE_FINAL_TYPE(GstFaceSticker, gst_face_sticker, GST, FACESTICKER,
 struct _GstFaceSticker {
   GstBaseTransform element;
 
-  gint min_confidence;
-
-  gboolean silent;
+  /* mode, effect, overlay_composition, sticker, atlas, scale, fps,
+   * min_confidence and silent, published as one snapshot */
+  ConfigStore *config;
+  StickerLoader *sticker_loader;
   gchar *eye_img_path;
-  gfloat eye_img_scale;
-  cv::Mat eye_img;
+  guint sprite_columns;
+  guint sprite_rows;
+  gchar *atlas_path;
+  StickerCache *sticker_cache;
+  AtlasCache *atlas_cache;
+
+  /* caches for the overlay_composition output, which is only used while
+   * downstream accepts the meta; asked again after every caps change */
+  gboolean overlay_checked;
+  gboolean overlay_supported;
+  StickerCache *overlay_cache;
+  AtlasCache *overlay_atlas_cache;
+  std::unordered_map<const void *, GstBuffer *> overlay_pixels;
 
   GstVideoInfo in_info;
   GstVideoInfo out_info;
 
   unsigned char *face_detection_buffer;
+
+  /* detection backend */
+  GstFaceStickerDetector detector;
+  gchar *detector_model;
+  FaceDetector *face_detector;
+
+  /* inference thread budget and placement */
+  guint n_threads;
+  gchar *cpu_affinity;
+  InferenceThreadConfig thread_config;
+
+  /* asynchronous detection */
+  gboolean async_detection;
+  guint detection_interval;
+  guint max_result_age;
+
+  gboolean shared_detection;
+  guint detection_priority;
+  guint max_in_flight;
+
+  AsyncDetector *detection_worker;
+  guint64 frame_count;
+  std::vector<FacialData> faces;
+  GstClockTime faces_pts;
+  guint64 faces_generation;
+
+  /* downscaled detection proxy */
+  guint detection_width;
+  cv::Mat detection_mat;
+  cv::Mat detection_yuv;
+
+  /* landmark tracking between keyframes */
+  guint keyframe_interval;
+  FaceTracker *face_tracker;
+
+  /* tiled parallel detection */
+  guint tile_size;
+  guint tile_overlap;
+  guint detection_threads;
+  DetectionPool *detection_pool;
+  GMutex tile_lock;
+  std::vector<cv::Rect> tiles;
+  std::vector<std::vector<FacialData>> tile_faces;
+
+  /* whole frames processed out of order, pushed in order */
+  guint parallel_frames;
+  gboolean parallel_active;
+  ParallelFrameQueue *frame_queue;
+  std::vector<FrameWorkerState> frame_workers;
+
+  /* re-detection around known faces between full scans */
+  guint full_scan_interval;
+  gdouble roi_expansion;
+
+  /* scene-change gating */
+  gdouble scene_threshold;
+  guint scene_max_reuse;
+  SceneChangeDetector *scene_detector;
+  guint scene_reuse_count;
+
+  /* detection trace recording and replay */
+  GstFaceStickerTraceMode trace_mode;
+  gchar *trace_path;
+  FaceTraceWriter *trace_writer;
+  FaceTraceReader *trace_reader;
+
+  /* detection records on the meta_src request pad, which is protected by
+   * the object lock */
+  GstFaceStickerMetaFormat meta_format;
+  GstPad *meta_pad;
+
+  /* performance counters */
+  StageStats *stats;
+  guint stats_interval;
+  GstClockTime last_stats_post;
+
+  /* QoS adaptation, proportion and jitter are protected by the object lock */
+  gboolean adaptive_qos;
+  gdouble qos_proportion;
+  GstClockTimeDiff qos_jitter;
+  guint qos_level;
+  guint64 qos_level_frame;
 };
 
 G_END_DECLS
 
 #endif /* __GST_FACESTICKER_H__ */
-
-typedef struct {
-  int confidence;
-  int x;
-  int y;
-  int width;
-  int height;
-  cv::Point leftEye;
-  cv::Point rightEye;
-  cv::Point nose;
-  cv::Point leftMouth;
-  cv::Point rightMouth;
-} FacialData;
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <dlfcn.h>
+#include <mutex>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "inferencethreads.hpp"
+
+#define INFERENCE_MAX_CPU 65535
+
+/* libfacedetection is built with or without OpenMP, so the runtime is looked
+ * up at run time instead of being linked in. */
+typedef void (*OmpSetNumThreads)(int);
+typedef int (*OmpGetMaxThreads)(void);
+
+static OmpSetNumThreads omp_set_num_threads_func = NULL;
+static OmpGetMaxThreads omp_get_max_threads_func = NULL;
+
+static void resolve_openmp() {
+  static std::once_flag resolved;
+
+  std::call_once(resolved, [] {
+    omp_set_num_threads_func =
+        (OmpSetNumThreads)dlsym(RTLD_DEFAULT, "omp_set_num_threads");
+    omp_get_max_threads_func =
+        (OmpGetMaxThreads)dlsym(RTLD_DEFAULT, "omp_get_max_threads");
+  });
+}
+
+static bool parse_cpu(const char *&p, int &cpu) {
+  char *end;
+  long value;
+
+  if (!g_ascii_isdigit(*p)) {
+    return false;
+  }
+
+  value = strtol(p, &end, 10);
+  if (value > INFERENCE_MAX_CPU) {
+    return false;
+  }
+
+  cpu = (int)value;
+  p = end;
+  return true;
+}
+
+bool inference_threads_parse_cpus(const char *spec, std::vector<int> &cpus) {
+  const char *p = spec;
+
+  cpus.clear();
+  if (!p) {
+    return true;
+  }
+
+  while (*p) {
+    int first, last;
+
+    while (g_ascii_isspace(*p)) {
+      p++;
+    }
+    if (!parse_cpu(p, first)) {
+      return false;
+    }
+
+    last = first;
+    if (*p == '-') {
+      p++;
+      if (!parse_cpu(p, last) || last < first) {
+        return false;
+      }
+    }
+
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+
+    while (g_ascii_isspace(*p)) {
+      p++;
+    }
+    if (*p == ',') {
+      p++;
+    } else if (*p) {
+      return false;
+    }
+  }
+
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return true;
+}
+
+int inference_threads_pool_size(const InferenceThreadConfig &config,
+                                 int requested) {
+  int size = requested;
+
+  if (size <= 0) {
+    size = config.cpus.empty() ? (int)g_get_num_processors()
+                               : (int)config.cpus.size();
+  }
+  if (config.n_threads > 0) {
+    size = std::min(size, config.n_threads);
+  }
+
+  return std::max(size, 1);
+}
+
+int inference_threads_openmp_share(const InferenceThreadConfig &config,
+                                   int concurrency) {
+  int budget = config.n_threads;
+
+  /* pinned without a bound: do not let OpenMP start one thread per CPU of
+   * the machine on the few chosen ones */
+  if (budget <= 0 && !config.cpus.empty()) {
+    budget = (int)config.cpus.size();
+  }
+  if (budget <= 0) {
+    return 0;
+  }
+
+  return std::max(budget / std::max(concurrency, 1), 1);
+}
+
+bool inference_threads_pin(const std::vector<int> &cpus) {
+  if (cpus.empty()) {
+    return true;
+  }
+
+#ifdef __linux__
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+void inference_threads_limit_openmp(int n_threads) {
+  if (n_threads <= 0) {
+    return;
+  }
+
+  resolve_openmp();
+  if (omp_set_num_threads_func) {
+    omp_set_num_threads_func(n_threads);
+  }
+}
+
+int inference_threads_openmp_max() {
+  resolve_openmp();
+
+  return omp_get_max_threads_func ? omp_get_max_threads_func() : 0;
+}
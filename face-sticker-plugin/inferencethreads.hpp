@@ -0,0 +1,43 @@
+#ifndef __INFERENCE_THREADS_H__
+#define __INFERENCE_THREADS_H__
+
+#include <vector>
+
+/* How many threads may run inference and where.
+ *
+ * @n_threads bounds the element's inference threads together with the
+ * OpenMP threads libfacedetection may start from each of them; 0 leaves both
+ * unbounded. @cpus lists the CPUs the threads are pinned to, empty leaves
+ * them to the scheduler. */
+typedef struct {
+  int n_threads;
+  std::vector<int> cpus;
+} InferenceThreadConfig;
+
+/* Parses a CPU list such as "0-3,6" into @cpus, sorted and without
+ * duplicates. Returns false on malformed input. */
+bool inference_threads_parse_cpus(const char *spec, std::vector<int> &cpus);
+
+/* Returns the size of a pool that would like @requested threads, or one per
+ * usable CPU when @requested is 0. */
+int inference_threads_pool_size(const InferenceThreadConfig &config,
+                                 int requested);
+
+/* Returns the OpenMP threads each of @concurrency inference threads running
+ * at once may use, or 0 to leave the runtime's default. */
+int inference_threads_openmp_share(const InferenceThreadConfig &config,
+                                   int concurrency);
+
+/* Pins the calling thread to @cpus. Returns false if that is not supported
+ * or the CPUs are not available. */
+bool inference_threads_pin(const std::vector<int> &cpus);
+
+/* Limits the parallel regions started by the calling thread to @n_threads.
+ * Does nothing for 0 or when no OpenMP runtime is loaded. */
+void inference_threads_limit_openmp(int n_threads);
+
+/* Returns the calling thread's OpenMP thread limit, or 0 when no OpenMP
+ * runtime is loaded. */
+int inference_threads_openmp_max();
+
+#endif /* __INFERENCE_THREADS_H__ */
@@ -0,0 +1,37 @@
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "scenechange.hpp"
+
+#define SCENE_SIGNATURE_WIDTH 64
+
+SceneChangeDetector::SceneChangeDetector() {}
+
+void SceneChangeDetector::reset() {
+  current.release();
+  reference.release();
+}
+
+double SceneChangeDetector::difference(const cv::Mat &image) {
+  int width = std::min(SCENE_SIGNATURE_WIDTH, image.cols);
+  int height =
+      std::max(1, (int)((long long)image.rows * width / image.cols));
+
+  /* shrink first so the color conversion only touches the signature */
+  if (image.channels() == 1) {
+    cv::resize(image, current, cv::Size(width, height), 0, 0,
+               cv::INTER_AREA);
+  } else {
+    cv::resize(image, scaled, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    cv::cvtColor(scaled, current, cv::COLOR_BGR2GRAY);
+  }
+
+  if (reference.empty() || reference.size() != current.size()) {
+    return -1.0;
+  }
+
+  return cv::norm(current, reference, cv::NORM_L1) / (double)current.total();
+}
+
+void SceneChangeDetector::accept() { current.copyTo(reference); }
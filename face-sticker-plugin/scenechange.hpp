@@ -0,0 +1,31 @@
+#ifndef __SCENE_CHANGE_H__
+#define __SCENE_CHANGE_H__
+
+#include <opencv2/core/mat.hpp>
+
+/* Cheap check whether a frame differs from the last one faces were found on.
+ *
+ * A frame is reduced to a small grayscale signature, SCENE_SIGNATURE_WIDTH
+ * pixels wide, and compared with the reference signature by mean absolute
+ * difference. Both BGR frames and luma planes are accepted. */
+class SceneChangeDetector {
+public:
+  SceneChangeDetector();
+
+  /* Computes the signature of @image and returns its mean absolute
+   * difference (0-255) to the reference, or a negative value when there is
+   * no comparable reference. */
+  double difference(const cv::Mat &image);
+
+  /* Makes the signature of the last difference() call the reference. */
+  void accept();
+
+  void reset();
+
+private:
+  cv::Mat scaled;
+  cv::Mat current;
+  cv::Mat reference;
+};
+
+#endif /* __SCENE_CHANGE_H__ */
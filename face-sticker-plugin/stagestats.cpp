@@ -0,0 +1,111 @@
+#include <algorithm>
+
+#include "stagestats.hpp"
+
+#define STATS_WINDOW 1024
+
+static const char *stage_names[STATS_N_STAGES] = {
+    "map", "detect", "track", "resize", "blend", "draw", "anonymize"};
+
+static const char *counter_names[STATS_N_COUNTERS] = {
+    "frames", "detections", "faces", "scene-hits", "scene-misses"};
+
+StageStats::StageStats() : inference_threads(0), openmp_threads(0) {
+  for (Stage &stage : stages) {
+    stage.window.reserve(STATS_WINDOW);
+  }
+  sorted.reserve(STATS_WINDOW);
+
+  reset();
+}
+
+void StageStats::reset() {
+  std::lock_guard<std::mutex> guard(lock);
+
+  for (Stage &stage : stages) {
+    stage.count = 0;
+    stage.total = 0;
+    stage.min = GST_CLOCK_TIME_NONE;
+    stage.window.clear();
+    stage.next = 0;
+  }
+  for (guint64 &counter : counters) {
+    counter = 0;
+  }
+}
+
+void StageStats::record(StatsStage index, GstClockTime duration) {
+  std::lock_guard<std::mutex> guard(lock);
+  Stage &stage = stages[index];
+
+  stage.count++;
+  stage.total += duration;
+  stage.min = std::min(stage.min, duration);
+
+  if (stage.window.size() < STATS_WINDOW) {
+    stage.window.push_back(duration);
+  } else {
+    stage.window[stage.next] = duration;
+    stage.next = (stage.next + 1) % STATS_WINDOW;
+  }
+}
+
+void StageStats::count(StatsCounter counter, guint64 amount) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  counters[counter] += amount;
+}
+
+void StageStats::set_threads(guint inference, guint openmp) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  inference_threads = inference;
+  openmp_threads = openmp;
+}
+
+GstStructure *StageStats::to_structure() {
+  std::lock_guard<std::mutex> guard(lock);
+  GstStructure *structure = gst_structure_new_empty("facesticker-stats");
+
+  for (int i = 0; i < STATS_N_COUNTERS; i++) {
+    gst_structure_set(structure, counter_names[i], G_TYPE_UINT64, counters[i],
+                      NULL);
+  }
+
+  gst_structure_set(structure, "inference-threads", G_TYPE_UINT,
+                    inference_threads, "openmp-threads", G_TYPE_UINT,
+                    openmp_threads, NULL);
+
+  for (int i = 0; i < STATS_N_STAGES; i++) {
+    const Stage &stage = stages[i];
+    GstClockTime p95 = 0, p99 = 0;
+
+    if (!stage.window.empty()) {
+      sorted.assign(stage.window.begin(), stage.window.end());
+      std::sort(sorted.begin(), sorted.end());
+      p95 = sorted[(sorted.size() - 1) * 95 / 100];
+      p99 = sorted[(sorted.size() - 1) * 99 / 100];
+    }
+
+    gchar *count = g_strdup_printf("%s-count", stage_names[i]);
+    gchar *min = g_strdup_printf("%s-min", stage_names[i]);
+    gchar *mean = g_strdup_printf("%s-mean", stage_names[i]);
+    gchar *p95_name = g_strdup_printf("%s-p95", stage_names[i]);
+    gchar *p99_name = g_strdup_printf("%s-p99", stage_names[i]);
+
+    gst_structure_set(
+        structure, count, G_TYPE_UINT64, stage.count, min, G_TYPE_UINT64,
+        (guint64)(stage.count ? stage.min : 0), mean, G_TYPE_UINT64,
+        (guint64)(stage.count ? stage.total / stage.count : 0), p95_name,
+        G_TYPE_UINT64, (guint64)p95, p99_name, G_TYPE_UINT64, (guint64)p99,
+        NULL);
+
+    g_free(count);
+    g_free(min);
+    g_free(mean);
+    g_free(p95_name);
+    g_free(p99_name);
+  }
+
+  return structure;
+}
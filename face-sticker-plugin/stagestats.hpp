@@ -0,0 +1,84 @@
+#ifndef __STAGE_STATS_H__
+#define __STAGE_STATS_H__
+
+#include <mutex>
+#include <vector>
+
+#include <gst/gst.h>
+
+typedef enum {
+  STATS_STAGE_MAP,
+  STATS_STAGE_DETECT,
+  STATS_STAGE_TRACK,
+  STATS_STAGE_RESIZE,
+  STATS_STAGE_BLEND,
+  STATS_STAGE_DRAW,
+  STATS_STAGE_ANONYMIZE,
+  STATS_N_STAGES
+} StatsStage;
+
+typedef enum {
+  STATS_COUNTER_FRAMES,
+  STATS_COUNTER_DETECTIONS,
+  STATS_COUNTER_FACES,
+  STATS_COUNTER_SCENE_HITS,
+  STATS_COUNTER_SCENE_MISSES,
+  STATS_N_COUNTERS
+} StatsCounter;
+
+/* Per-stage timings and event counters of one element.
+ *
+ * Every stage keeps its sample count, minimum and mean since the last
+ * reset(), plus the latest STATS_WINDOW samples from which the p95 and p99
+ * latencies are computed. Samples may be recorded from any thread. */
+class StageStats {
+public:
+  StageStats();
+
+  void record(StatsStage stage, GstClockTime duration);
+  void count(StatsCounter counter, guint64 amount = 1);
+  void reset();
+
+  /* Records the threads currently running inference and the OpenMP threads
+   * each may use. Kept across reset(). */
+  void set_threads(guint inference_threads, guint openmp_threads);
+
+  /* Returns a new "facesticker-stats" structure with every counter, the
+   * "inference-threads" and "openmp-threads" counts and, for each stage,
+   * "<stage>-count", "-min", "-mean", "-p95" and "-p99" in nanoseconds. */
+  GstStructure *to_structure();
+
+private:
+  typedef struct {
+    guint64 count;
+    GstClockTime total;
+    GstClockTime min;
+    std::vector<GstClockTime> window;
+    size_t next;
+  } Stage;
+
+  std::mutex lock;
+  Stage stages[STATS_N_STAGES];
+  guint64 counters[STATS_N_COUNTERS];
+  guint inference_threads;
+  guint openmp_threads;
+  std::vector<GstClockTime> sorted;
+};
+
+/* Records the time from construction to destruction as one @stage sample. */
+class StageTimer {
+public:
+  StageTimer(StageStats *stats, StatsStage stage)
+      : stats(stats), stage(stage), start(gst_util_get_timestamp()) {}
+  ~StageTimer() { stats->record(stage, gst_util_get_timestamp() - start); }
+
+  StageTimer(const StageTimer &) = delete;
+  StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+  StageStats *stats;
+  StatsStage stage;
+  GstClockTime start;
+};
+
+#endif /* __STAGE_STATS_H__ */
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "stickeratlas.hpp"
+
+#define ATLAS_GROUP "atlas"
+
+static const struct {
+  const char *name;
+  StickerAnchor anchor;
+} anchor_names[] = {
+    {"eyes", STICKER_ANCHOR_EYES},
+    {"left-eye", STICKER_ANCHOR_LEFT_EYE},
+    {"right-eye", STICKER_ANCHOR_RIGHT_EYE},
+    {"nose", STICKER_ANCHOR_NOSE},
+    {"mouth", STICKER_ANCHOR_MOUTH},
+    {"face", STICKER_ANCHOR_FACE},
+};
+
+std::shared_ptr<const StickerAtlas> StickerAtlas::load(const char *path,
+                                                       GError **error) {
+  std::shared_ptr<StickerAtlas> atlas = std::make_shared<StickerAtlas>();
+  GKeyFile *keys = g_key_file_new();
+  bool ok = atlas->read(keys, path, error);
+
+  g_key_file_free(keys);
+  if (!ok) {
+    return NULL;
+  }
+
+  atlas->path = path;
+  return atlas;
+}
+
+bool StickerAtlas::read(GKeyFile *keys, const char *path, GError **error) {
+  if (!g_key_file_load_from_file(keys, path, G_KEY_FILE_NONE, error)) {
+    return false;
+  }
+
+  gchar *name = g_key_file_get_string(keys, ATLAS_GROUP, "image", error);
+  if (!name) {
+    return false;
+  }
+
+  gchar *dir = g_path_get_dirname(path);
+  gchar *image_path = g_path_is_absolute(name)
+                          ? g_strdup(name)
+                          : g_build_filename(dir, name, NULL);
+
+  image = StickerCache::prepare_source(
+      cv::imread(image_path, cv::IMREAD_UNCHANGED));
+  if (image.empty()) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "Failed to read atlas image %s", image_path);
+  }
+
+  g_free(image_path);
+  g_free(dir);
+  g_free(name);
+  if (image.empty()) {
+    return false;
+  }
+
+  gchar **groups = g_key_file_get_groups(keys, NULL);
+  bool ok = true;
+
+  for (gchar **group = groups; ok && *group; group++) {
+    AtlasSprite sprite;
+
+    if (g_strcmp0(*group, ATLAS_GROUP) == 0) {
+      continue;
+    }
+
+    ok = read_sprite(keys, *group, sprite, error);
+    if (ok) {
+      sprites.push_back(sprite);
+    }
+  }
+
+  g_strfreev(groups);
+  return ok;
+}
+
+bool StickerAtlas::read_sprite(GKeyFile *keys, const gchar *group,
+                               AtlasSprite &sprite, GError **error) {
+  GError *local = NULL;
+  gsize length = 0;
+
+  sprite.name = group;
+  sprite.scale = 1.0;
+  sprite.offset = cv::Point2d(0, 0);
+
+  gint *rect = g_key_file_get_integer_list(keys, group, "rect", &length, error);
+  if (!rect) {
+    return false;
+  }
+
+  cv::Rect area;
+  if (length == 4) {
+    area = cv::Rect(rect[0], rect[1], rect[2], rect[3]);
+  }
+  g_free(rect);
+
+  if (area.area() <= 0 ||
+      (area & cv::Rect(0, 0, image.cols, image.rows)) != area) {
+    g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                "Sprite %s: rect must be x;y;width;height inside the image",
+                group);
+    return false;
+  }
+  sprite.source = image(area);
+
+  gchar *anchor = g_key_file_get_string(keys, group, "anchor", error);
+  if (!anchor) {
+    return false;
+  }
+
+  bool known = false;
+  for (const auto &entry : anchor_names) {
+    if (g_strcmp0(anchor, entry.name) == 0) {
+      sprite.anchor = entry.anchor;
+      known = true;
+    }
+  }
+  if (!known) {
+    g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                "Sprite %s: unknown anchor %s", group, anchor);
+  }
+  g_free(anchor);
+  if (!known) {
+    return false;
+  }
+
+  if (g_key_file_has_key(keys, group, "scale", NULL)) {
+    sprite.scale = g_key_file_get_double(keys, group, "scale", &local);
+    if (local || sprite.scale <= 0) {
+      if (!local) {
+        g_set_error(&local, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                    "Sprite %s: scale must be positive", group);
+      }
+      g_propagate_error(error, local);
+      return false;
+    }
+  }
+
+  if (g_key_file_has_key(keys, group, "offset", NULL)) {
+    gdouble *offset =
+        g_key_file_get_double_list(keys, group, "offset", &length, error);
+    if (!offset) {
+      return false;
+    }
+
+    bool valid = length == 2;
+    if (valid) {
+      sprite.offset = cv::Point2d(offset[0], offset[1]);
+    }
+    g_free(offset);
+
+    if (!valid) {
+      g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                  "Sprite %s: offset must be x;y", group);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+AtlasCache::AtlasCache() : format(GST_VIDEO_FORMAT_BGR), clock(0) {
+  rotations.reserve(ATLAS_MAX_ROTATIONS);
+}
+
+AtlasCache::~AtlasCache() {
+  for (Rotation &rotation : rotations) {
+    delete rotation.cache;
+  }
+}
+
+void AtlasCache::set_format(GstVideoFormat new_format) {
+  format = new_format;
+  for (Rotation &rotation : rotations) {
+    rotation.cache->set_format(format);
+  }
+}
+
+void AtlasCache::use_atlas(const std::shared_ptr<const StickerAtlas> &next) {
+  if (next == atlas) {
+    return;
+  }
+
+  /* keep the caches for their buffers, only forget what they hold */
+  atlas = next;
+  for (Rotation &rotation : rotations) {
+    rotation.sprite = -1;
+    rotation.last_used = 0;
+  }
+}
+
+/* Returns @sprite rotated by @step angle steps, rotating it on a miss. The
+ * canvas grows to the rotated bounds, so nothing is cut off. */
+AtlasCache::Rotation &AtlasCache::rotation(int sprite, int step) {
+  Rotation *victim = NULL;
+
+  clock++;
+  for (Rotation &rotation : rotations) {
+    if (rotation.sprite == sprite && rotation.step == step) {
+      rotation.last_used = clock;
+      return rotation;
+    }
+    if (!victim || rotation.last_used < victim->last_used) {
+      victim = &rotation;
+    }
+  }
+
+  if (rotations.size() < ATLAS_MAX_ROTATIONS) {
+    rotations.push_back({-1, 0, 0, cv::Mat(), new StickerCache()});
+    victim = &rotations.back();
+    victim->cache->set_format(format);
+  }
+
+  const cv::Mat &source = atlas->sprites[sprite].source;
+  if (step == 0) {
+    victim->source = source;
+  } else {
+    /* image y points down, so the eye line angle turns clockwise */
+    gdouble degrees = -step * ATLAS_ANGLE_STEP;
+    cv::Point2f centre(source.cols / 2.0f, source.rows / 2.0f);
+    cv::Rect2f bounds =
+        cv::RotatedRect(centre, source.size(), degrees).boundingRect2f();
+    cv::Mat matrix = cv::getRotationMatrix2D(centre, degrees, 1.0);
+
+    matrix.at<double>(0, 2) += bounds.width / 2.0 - centre.x;
+    matrix.at<double>(1, 2) += bounds.height / 2.0 - centre.y;
+
+    /* premultiplied, so the transparent border blends in cleanly */
+    victim->source = cv::Mat();
+    cv::warpAffine(source, victim->source, matrix,
+                   cv::Size((int)std::ceil(bounds.width),
+                            (int)std::ceil(bounds.height)),
+                   cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar());
+  }
+
+  /* the new source may reuse the old one's memory */
+  victim->cache->use_source(victim->source);
+  victim->cache->invalidate();
+  victim->sprite = sprite;
+  victim->step = step;
+  victim->last_used = clock;
+
+  return *victim;
+}
+
+const std::vector<AtlasPlacement> &
+AtlasCache::place(const FacialData &face, int x_align, int y_align) {
+  placements.clear();
+  if (!atlas) {
+    return placements;
+  }
+
+  cv::Point2d eye_line = face.rightEye - face.leftEye;
+  gdouble distance = std::hypot(eye_line.x, eye_line.y);
+  if (distance < 1) {
+    return placements;
+  }
+
+  gdouble angle = std::atan2(eye_line.y, eye_line.x);
+  gdouble cos_angle = std::cos(angle);
+  gdouble sin_angle = std::sin(angle);
+  int n_steps = 360 / ATLAS_ANGLE_STEP;
+  int step = (int)std::lround(angle * 180 / G_PI / ATLAS_ANGLE_STEP);
+  step = (step % n_steps + n_steps) % n_steps;
+
+  for (size_t i = 0; i < atlas->sprites.size(); i++) {
+    const AtlasSprite &sprite = atlas->sprites[i];
+    cv::Point2d anchors[2];
+    int n_anchors = 1;
+
+    switch (sprite.anchor) {
+    case STICKER_ANCHOR_EYES:
+      anchors[0] = face.leftEye;
+      anchors[1] = face.rightEye;
+      n_anchors = 2;
+      break;
+    case STICKER_ANCHOR_LEFT_EYE:
+      anchors[0] = face.leftEye;
+      break;
+    case STICKER_ANCHOR_RIGHT_EYE:
+      anchors[0] = face.rightEye;
+      break;
+    case STICKER_ANCHOR_NOSE:
+      anchors[0] = face.nose;
+      break;
+    case STICKER_ANCHOR_MOUTH:
+      anchors[0] = cv::Point2d(face.leftMouth + face.rightMouth) * 0.5;
+      break;
+    case STICKER_ANCHOR_FACE:
+      anchors[0] = cv::Point2d(face.x + face.width / 2.0,
+                               face.y + face.height / 2.0);
+      break;
+    }
+
+    Rotation &rotated = rotation(i, step);
+    gdouble factor = sprite.scale * distance / sprite.source.cols;
+    const StickerSprite *scaled =
+        rotated.cache->lookup(cv::Size(cvRound(rotated.source.cols * factor),
+                                       cvRound(rotated.source.rows * factor)));
+    if (!scaled) {
+      continue;
+    }
+
+    /* the offset turns with the face */
+    cv::Point2d offset(
+        (sprite.offset.x * cos_angle - sprite.offset.y * sin_angle) * distance,
+        (sprite.offset.x * sin_angle + sprite.offset.y * cos_angle) *
+            distance);
+    cv::Size size = scaled->color[0].size();
+
+    for (int k = 0; k < n_anchors; k++) {
+      cv::Point2d centre = anchors[k] + offset;
+      cv::Point origin(cvFloor(centre.x - size.width / 2.0) & ~(x_align - 1),
+                       cvFloor(centre.y - size.height / 2.0) & ~(y_align - 1));
+
+      placements.push_back({scaled, origin});
+    }
+  }
+
+  return placements;
+}
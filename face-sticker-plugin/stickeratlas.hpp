@@ -0,0 +1,129 @@
+#ifndef __STICKER_ATLAS_H__
+#define __STICKER_ATLAS_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+#include <gst/video/video-format.h>
+#include <opencv2/core/mat.hpp>
+
+#include "facialdata.hpp"
+#include "stickercache.hpp"
+
+/* Rotations are cached in steps of this many degrees */
+#define ATLAS_ANGLE_STEP 5
+
+/* (sprite, rotation) pairs an AtlasCache keeps scaled sprites for */
+#define ATLAS_MAX_ROTATIONS 64
+
+typedef enum {
+  STICKER_ANCHOR_EYES,
+  STICKER_ANCHOR_LEFT_EYE,
+  STICKER_ANCHOR_RIGHT_EYE,
+  STICKER_ANCHOR_NOSE,
+  STICKER_ANCHOR_MOUTH,
+  STICKER_ANCHOR_FACE,
+} StickerAnchor;
+
+/* One named sprite of an atlas. It is centred on its anchor, moved by
+ * @offset and made @scale times as wide as the distance between the eyes.
+ * The offset is counted in eye distances along the face's own axes. */
+typedef struct {
+  std::string name;
+  StickerAnchor anchor;
+  gdouble scale;
+  cv::Point2d offset;
+  /* premultiplied BGRA, a view into the atlas image */
+  cv::Mat source;
+} AtlasSprite;
+
+/* A packed sticker image and the sprites cut from it, described by a key
+ * file:
+ *
+ *   [atlas]
+ *   image=stickers.png
+ *
+ *   [glasses]
+ *   rect=0;0;256;96
+ *   anchor=face
+ *   scale=2.2
+ *   offset=0;-0.4
+ *
+ * The image path is relative to the key file. Every other group is a sprite:
+ * rect is x;y;width;height in the image, anchor one of eyes (one copy on
+ * each eye), left-eye, right-eye, nose, mouth or face (the centre of the face
+ * box), and scale (default 1.0) and offset (default 0;0) place it as
+ * described for AtlasSprite. Never modified once loaded, so it may be shared
+ * by any thread. */
+class StickerAtlas {
+public:
+  static std::shared_ptr<const StickerAtlas> load(const char *path,
+                                                  GError **error);
+
+  std::string path;
+  std::vector<AtlasSprite> sprites;
+
+private:
+  bool read(GKeyFile *keys, const char *path, GError **error);
+  bool read_sprite(GKeyFile *keys, const gchar *group, AtlasSprite &sprite,
+                   GError **error);
+
+  cv::Mat image;
+};
+
+/* Where one scaled and rotated sprite goes on the frame. */
+typedef struct {
+  const StickerSprite *sprite;
+  cv::Point origin;
+} AtlasPlacement;
+
+/* Rotates and scales the sprites of an atlas onto faces.
+ *
+ * The eye line gives the rotation, rounded to ATLAS_ANGLE_STEP degrees. Each
+ * sprite is rotated once per angle step it is seen at and handed to a
+ * StickerCache, which keeps it scaled to the sizes recently asked for. So a
+ * face costs a few lookups per sprite once its angle and size have been
+ * seen. The least recently used rotation is recycled when
+ * ATLAS_MAX_ROTATIONS are kept. */
+class AtlasCache {
+public:
+  AtlasCache();
+  ~AtlasCache();
+
+  AtlasCache(const AtlasCache &) = delete;
+  AtlasCache &operator=(const AtlasCache &) = delete;
+
+  /* Same as StickerCache::set_format(). */
+  void set_format(GstVideoFormat format);
+
+  /* Switches to @atlas, dropping every cached sprite when it changes. */
+  void use_atlas(const std::shared_ptr<const StickerAtlas> &atlas);
+
+  /* Returns the placement of every sprite of the atlas on @face. Origins
+   * may lie outside the frame; they are rounded down to multiples of
+   * @x_align and @y_align (powers of two), e.g. to keep subsampled planes
+   * aligned. Valid until the next call. */
+  const std::vector<AtlasPlacement> &place(const FacialData &face,
+                                           int x_align, int y_align);
+
+private:
+  typedef struct {
+    int sprite;
+    int step;
+    guint64 last_used;
+    cv::Mat source;
+    StickerCache *cache;
+  } Rotation;
+
+  Rotation &rotation(int sprite, int step);
+
+  GstVideoFormat format;
+  std::shared_ptr<const StickerAtlas> atlas;
+  std::vector<Rotation> rotations;
+  std::vector<AtlasPlacement> placements;
+  guint64 clock;
+};
+
+#endif /* __STICKER_ATLAS_H__ */
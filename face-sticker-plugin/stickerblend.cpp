@@ -0,0 +1,139 @@
+#include "stickerblend.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define STICKER_BLEND_SSE2 1
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define STICKER_BLEND_AVX2 1
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define STICKER_BLEND_NEON 1
+#endif
+
+/* x * y / 255 rounded to nearest, exact for 8-bit inputs */
+static inline uint8_t mul_div255(unsigned x, unsigned y) {
+  unsigned t = x * y + 128;
+  return (uint8_t)((t + (t >> 8)) >> 8);
+}
+
+static void blend_row_scalar(uint8_t *dst, const uint8_t *src,
+                             const uint8_t *inv_alpha, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    unsigned value = src[i] + mul_div255(dst[i], inv_alpha[i]);
+    dst[i] = (uint8_t)(value > 255 ? 255 : value);
+  }
+}
+
+#ifdef STICKER_BLEND_SSE2
+static inline __m128i mul_div255_epi16(__m128i x, __m128i y) {
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(x, y), _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static size_t blend_row_sse2(uint8_t *dst, const uint8_t *src,
+                             const uint8_t *inv_alpha, size_t n) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+    __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i a = _mm_loadu_si128((const __m128i *)(inv_alpha + i));
+
+    __m128i lo = mul_div255_epi16(_mm_unpacklo_epi8(d, zero),
+                                  _mm_unpacklo_epi8(a, zero));
+    __m128i hi = mul_div255_epi16(_mm_unpackhi_epi8(d, zero),
+                                  _mm_unpackhi_epi8(a, zero));
+
+    __m128i blended = _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+    _mm_storeu_si128((__m128i *)(dst + i), blended);
+  }
+
+  return i;
+}
+#endif
+
+#ifdef STICKER_BLEND_AVX2
+__attribute__((target("avx2"))) static inline __m256i
+mul_div255_epi16_avx2(__m256i x, __m256i y) {
+  __m256i t =
+      _mm256_add_epi16(_mm256_mullo_epi16(x, y), _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+/* unpack and pack both work per 128-bit lane, so the bytes come back out in
+ * their original order */
+__attribute__((target("avx2"))) static size_t
+blend_row_avx2(uint8_t *dst, const uint8_t *src, const uint8_t *inv_alpha,
+               size_t n) {
+  const __m256i zero = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+    __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i a = _mm256_loadu_si256((const __m256i *)(inv_alpha + i));
+
+    __m256i lo = mul_div255_epi16_avx2(_mm256_unpacklo_epi8(d, zero),
+                                       _mm256_unpacklo_epi8(a, zero));
+    __m256i hi = mul_div255_epi16_avx2(_mm256_unpackhi_epi8(d, zero),
+                                       _mm256_unpackhi_epi8(a, zero));
+
+    __m256i blended = _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi));
+    _mm256_storeu_si256((__m256i *)(dst + i), blended);
+  }
+
+  return i;
+}
+
+static bool cpu_has_avx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+#endif
+
+#ifdef STICKER_BLEND_NEON
+static size_t blend_row_neon(uint8_t *dst, const uint8_t *src,
+                             const uint8_t *inv_alpha, size_t n) {
+  const uint16x8_t round = vdupq_n_u16(128);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t d = vld1q_u8(dst + i);
+    uint8x16_t s = vld1q_u8(src + i);
+    uint8x16_t a = vld1q_u8(inv_alpha + i);
+
+    uint16x8_t lo = vaddq_u16(vmull_u8(vget_low_u8(d), vget_low_u8(a)), round);
+    uint16x8_t hi =
+        vaddq_u16(vmull_u8(vget_high_u8(d), vget_high_u8(a)), round);
+
+    /* (t + (t >> 8)) >> 8, narrowed back to bytes */
+    uint8x16_t scaled = vcombine_u8(vaddhn_u16(lo, vshrq_n_u16(lo, 8)),
+                                    vaddhn_u16(hi, vshrq_n_u16(hi, 8)));
+
+    vst1q_u8(dst + i, vqaddq_u8(s, scaled));
+  }
+
+  return i;
+}
+#endif
+
+void sticker_blend_row(uint8_t *dst, const uint8_t *src,
+                       const uint8_t *inv_alpha, size_t n) {
+  size_t done = 0;
+
+#if defined(STICKER_BLEND_AVX2)
+  if (cpu_has_avx2()) {
+    done = blend_row_avx2(dst, src, inv_alpha, n);
+  }
+#endif
+#if defined(STICKER_BLEND_SSE2)
+  done += blend_row_sse2(dst + done, src + done, inv_alpha + done, n - done);
+#elif defined(STICKER_BLEND_NEON)
+  done = blend_row_neon(dst, src, inv_alpha, n);
+#endif
+
+  blend_row_scalar(dst + done, src + done, inv_alpha + done, n - done);
+}
@@ -0,0 +1,18 @@
+#ifndef __STICKER_BLEND_H__
+#define __STICKER_BLEND_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Composites a premultiplied-alpha sticker row over a frame row in place:
+ *
+ *   dst[i] = src[i] + dst[i] * inv_alpha[i] / 255
+ *
+ * All three arrays hold @n bytes in the frame's own channel layout, with the
+ * sticker's inverted alpha repeated for every channel of a pixel. Working on
+ * plain bytes keeps the kernel independent of the pixel format. Uses AVX2,
+ * SSE2 or NEON when available and a scalar loop otherwise. */
+void sticker_blend_row(uint8_t *dst, const uint8_t *src,
+                       const uint8_t *inv_alpha, size_t n);
+
+#endif /* __STICKER_BLEND_H__ */
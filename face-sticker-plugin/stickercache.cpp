@@ -0,0 +1,254 @@
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "stickercache.hpp"
+
+#define STICKER_CACHE_ENTRIES 32
+#define STICKER_CACHE_FRAMES 256
+#define STICKER_CACHE_QUANTUM 4
+
+static int quantize(int value) {
+  int rounded = (value + STICKER_CACHE_QUANTUM / 2) / STICKER_CACHE_QUANTUM *
+                STICKER_CACHE_QUANTUM;
+  return std::max(rounded, STICKER_CACHE_QUANTUM);
+}
+
+StickerCache::StickerCache()
+    : format(GST_VIDEO_FORMAT_BGR), n_frames(1), clock(0) {
+  entries.reserve(STICKER_CACHE_ENTRIES);
+}
+
+cv::Mat StickerCache::prepare_source(const cv::Mat &image) {
+  cv::Mat bgra, prepared;
+
+  if (image.empty()) {
+    return prepared;
+  }
+
+  if (image.depth() != CV_8U) {
+    image.convertTo(bgra, CV_8U, image.depth() == CV_16U ? 1.0 / 257 : 1.0);
+  } else {
+    bgra = image;
+  }
+
+  switch (bgra.channels()) {
+  case 1:
+    cv::cvtColor(bgra, bgra, cv::COLOR_GRAY2BGRA);
+    break;
+  case 2: {
+    /* gray and alpha */
+    cv::Mat channels[2], bgr;
+    cv::split(bgra, channels);
+    cv::cvtColor(channels[0], bgr, cv::COLOR_GRAY2BGR);
+    cv::cvtColor(bgr, bgra, cv::COLOR_BGR2BGRA);
+    cv::insertChannel(channels[1], bgra, 3);
+    break;
+  }
+  case 3: {
+    /* no alpha channel: key out the white background */
+    cv::Mat gray, alpha;
+    cv::cvtColor(bgra, gray, cv::COLOR_BGR2GRAY);
+    cv::compare(gray, 255, alpha, cv::CMP_NE);
+    cv::cvtColor(bgra, bgra, cv::COLOR_BGR2BGRA);
+    cv::insertChannel(alpha, bgra, 3);
+    break;
+  }
+  default:
+    break;
+  }
+
+  /* premultiply before any scaling so that filtering does not bleed the
+   * colour of transparent pixels into the edges */
+  cv::cvtColor(bgra, prepared, cv::COLOR_RGBA2mRGBA);
+  return prepared;
+}
+
+void StickerCache::set_source(const cv::Mat &image) {
+  use_source(prepare_source(image));
+}
+
+void StickerCache::use_source(const cv::Mat &prepared, int frames) {
+  /* views into one image, like the sprites of an atlas, may start at the
+   * same pixel, so the whole view is compared */
+  if (prepared.data == source.data && prepared.size() == source.size() &&
+      prepared.step[0] == source.step[0] && std::max(frames, 1) == n_frames) {
+    return;
+  }
+
+  invalidate();
+  source = prepared;
+  n_frames = std::max(frames, 1);
+
+  if (entries.size() > max_entries()) {
+    entries.resize(max_entries());
+  }
+}
+
+size_t StickerCache::max_entries() const {
+  return std::clamp(STICKER_CACHE_FRAMES / n_frames, 2, STICKER_CACHE_ENTRIES);
+}
+
+void StickerCache::invalidate() {
+  /* keep the entries' buffers around, only forget which size they hold */
+  for (Entry &entry : entries) {
+    entry.size = cv::Size();
+    entry.last_used = 0;
+  }
+}
+
+void StickerCache::set_format(GstVideoFormat new_format) {
+  if (new_format != format) {
+    format = new_format;
+    invalidate();
+  }
+}
+
+const StickerSprite *StickerCache::lookup(const cv::Size &size, int frame) {
+  if (source.empty() || size.width <= 0 || size.height <= 0) {
+    return NULL;
+  }
+
+  cv::Size key(quantize(size.width), quantize(size.height));
+  clock++;
+
+  frame %= n_frames;
+
+  Entry *victim = NULL;
+  for (Entry &entry : entries) {
+    if (entry.size == key) {
+      entry.last_used = clock;
+      return &entry.frames[frame];
+    }
+    if (!victim || entry.last_used < victim->last_used) {
+      victim = &entry;
+    }
+  }
+
+  if (entries.size() < max_entries()) {
+    entries.emplace_back();
+    victim = &entries.back();
+  }
+
+  scale_into(*victim, key);
+  victim->last_used = clock;
+
+  return &victim->frames[frame];
+}
+
+/* Scales each frame into its slot of one tall image, so the conversions
+ * below run once for the whole animation. Frame heights are multiples of
+ * STICKER_CACHE_QUANTUM, so subsampled rows never straddle two frames. */
+void StickerCache::scale_into(Entry &entry, const cv::Size &size) {
+  cv::Size frame_size(source.cols, source.rows / n_frames);
+  int interpolation = size.area() < frame_size.area() ? cv::INTER_AREA
+                                                       : cv::INTER_LINEAR;
+
+  scaled.create(size.height * n_frames, size.width, source.type());
+  for (int i = 0; i < n_frames; i++) {
+    cv::Mat from = source.rowRange(i * frame_size.height,
+                                   (i + 1) * frame_size.height);
+    cv::Mat to = scaled.rowRange(i * size.height, (i + 1) * size.height);
+
+    cv::resize(from, to, size, 0, 0, interpolation);
+  }
+
+  switch (format) {
+  case GST_VIDEO_FORMAT_I420:
+  case GST_VIDEO_FORMAT_NV12:
+    split_yuv(entry.pool);
+    break;
+  case GST_VIDEO_FORMAT_BGRA:
+    split_bgra(entry.pool);
+    break;
+  default:
+    split_bgr(entry.pool);
+    break;
+  }
+
+  slice_frames(entry);
+  entry.size = size;
+}
+
+void StickerCache::slice_frames(Entry &entry) {
+  const StickerSprite &pool = entry.pool;
+
+  entry.frames.resize(n_frames);
+  for (int i = 0; i < n_frames; i++) {
+    StickerSprite &sprite = entry.frames[i];
+
+    sprite.n_planes = pool.n_planes;
+    for (int plane = 0; plane < pool.n_planes; plane++) {
+      int rows = pool.color[plane].rows / n_frames;
+
+      sprite.color[plane] =
+          pool.color[plane].rowRange(i * rows, (i + 1) * rows);
+      sprite.inv_alpha[plane] =
+          pool.inv_alpha[plane].empty()
+              ? cv::Mat()
+              : pool.inv_alpha[plane].rowRange(i * rows, (i + 1) * rows);
+    }
+  }
+}
+
+void StickerCache::split_bgr(StickerSprite &sprite) {
+  sprite.n_planes = 1;
+  sprite.color[0].create(scaled.size(), CV_8UC3);
+  sprite.inv_alpha[0].create(scaled.size(), CV_8UC3);
+
+  cv::Mat outputs[] = {sprite.color[0], sprite.inv_alpha[0]};
+  const int from_to[] = {0, 0, 1, 1, 2, 2, 3, 3, 3, 4, 3, 5};
+  cv::mixChannels(&scaled, 1, outputs, 2, from_to, 6);
+  cv::bitwise_not(sprite.inv_alpha[0], sprite.inv_alpha[0]);
+}
+
+/* Converts the straight (not premultiplied) colours to 4:2:0 YUV and
+ * premultiplies each plane with the alpha at its own resolution. The sizes
+ * are multiples of STICKER_CACHE_QUANTUM, so they are always even. */
+void StickerCache::split_yuv(StickerSprite &sprite) {
+  int width = scaled.cols;
+  int height = scaled.rows;
+  cv::Size chroma_size(width / 2, height / 2);
+
+  cv::cvtColor(scaled, straight, cv::COLOR_mRGBA2RGBA);
+  cv::cvtColor(straight, yuv, cv::COLOR_BGRA2YUV_I420);
+  cv::extractChannel(straight, alpha, 3);
+  cv::resize(alpha, chroma_alpha, chroma_size, 0, 0, cv::INTER_AREA);
+
+  /* I420 layout: full Y plane followed by the U and V planes */
+  cv::Mat y(height, width, CV_8UC1, yuv.ptr(0));
+  cv::Mat u(chroma_size, CV_8UC1, yuv.ptr(height));
+  cv::Mat v(chroma_size, CV_8UC1, yuv.ptr(height) + chroma_size.area());
+
+  cv::multiply(y, alpha, sprite.color[0], 1.0 / 255);
+  cv::bitwise_not(alpha, sprite.inv_alpha[0]);
+
+  cv::Mat u_premultiplied, v_premultiplied;
+  cv::multiply(u, chroma_alpha, u_premultiplied, 1.0 / 255);
+  cv::multiply(v, chroma_alpha, v_premultiplied, 1.0 / 255);
+  cv::bitwise_not(chroma_alpha, chroma_alpha);
+
+  if (format == GST_VIDEO_FORMAT_I420) {
+    sprite.n_planes = 3;
+    sprite.color[1] = u_premultiplied;
+    sprite.color[2] = v_premultiplied;
+    chroma_alpha.copyTo(sprite.inv_alpha[1]);
+    sprite.inv_alpha[2] = sprite.inv_alpha[1];
+  } else {
+    cv::Mat uv[] = {u_premultiplied, v_premultiplied};
+    cv::Mat inv_alpha[] = {chroma_alpha, chroma_alpha};
+
+    sprite.n_planes = 2;
+    cv::merge(uv, 2, sprite.color[1]);
+    cv::merge(inv_alpha, 2, sprite.inv_alpha[1]);
+  }
+}
+
+/* Copies into fresh memory rather than reusing the entry's buffer, since the
+ * previous pixels may still be referenced by an overlay downstream. */
+void StickerCache::split_bgra(StickerSprite &sprite) {
+  sprite.n_planes = 1;
+  sprite.color[0] = cv::Mat();
+  sprite.inv_alpha[0] = cv::Mat();
+  scaled.copyTo(sprite.color[0]);
+}
@@ -0,0 +1,99 @@
+#ifndef __STICKER_CACHE_H__
+#define __STICKER_CACHE_H__
+
+#include <vector>
+
+#include <glib.h>
+#include <gst/video/video-format.h>
+#include <opencv2/core/mat.hpp>
+
+#define STICKER_MAX_PLANES 3
+
+/* A sticker scaled to one size and laid out like the frame it is blended
+ * into, one entry per plane, ready for sticker_blend_row(): @color holds the
+ * premultiplied pixels and @inv_alpha the inverted alpha repeated for each
+ * channel of the plane. Chroma planes are subsampled like the frame's.
+ *
+ * For the BGRA layout @color[0] is the premultiplied BGRA image itself and
+ * @inv_alpha is unused. Its pixels are never modified once returned, so they
+ * may be shared with buffers that outlive the cache entry. */
+typedef struct {
+  int n_planes;
+  cv::Mat color[STICKER_MAX_PLANES];
+  cv::Mat inv_alpha[STICKER_MAX_PLANES];
+} StickerSprite;
+
+/* Keeps the sticker image pre-scaled to the sizes recently asked for.
+ *
+ * Requested sizes are rounded to STICKER_CACHE_QUANTUM pixels so that the
+ * small frame-to-frame jitter of detected face sizes keeps hitting the same
+ * entries. Up to STICKER_CACHE_ENTRIES sizes are kept; the least recently
+ * used one is recycled on a miss, reusing its buffers where possible.
+ *
+ * An animated source is scaled as a whole: an entry holds every frame of the
+ * animation at its size, stacked in one contiguous buffer per plane, so
+ * stepping through the frames never scales anything. Entries are then
+ * limited to STICKER_CACHE_FRAMES frames in total. */
+class StickerCache {
+public:
+  StickerCache();
+
+  /* Converts @image into the premultiplied BGRA source the cache scales
+   * from. @image may be grayscale, BGR or BGRA; without an alpha channel the
+   * white pixels are treated as transparent background. */
+  static cv::Mat prepare_source(const cv::Mat &image);
+
+  /* Replaces the source image and drops every cached size. */
+  void set_source(const cv::Mat &image);
+
+  /* Switches to a source made by prepare_source(), sharing its pixels.
+   * @prepared holds @n_frames equally sized animation frames stacked
+   * vertically. Does nothing when the same pixels, size, stride and frame
+   * count are already in use. */
+  void use_source(const cv::Mat &prepared, int n_frames = 1);
+  void invalidate();
+
+  /* Selects the frame layout the sprites are produced for: BGR, I420, NV12
+   * or BGRA for overlay rectangles. Drops every cached size when the layout
+   * changes. */
+  void set_format(GstVideoFormat format);
+
+  /* Returns animation frame @frame (wrapping around) of the sticker scaled
+   * to roughly @size, or NULL when there is no source image or @size is
+   * empty. */
+  const StickerSprite *lookup(const cv::Size &size, int frame = 0);
+
+private:
+  typedef struct {
+    cv::Size size;
+    guint64 last_used;
+    /* every frame stacked, and one view into it per frame */
+    StickerSprite pool;
+    std::vector<StickerSprite> frames;
+  } Entry;
+
+  size_t max_entries() const;
+  void slice_frames(Entry &entry);
+
+  void scale_into(Entry &entry, const cv::Size &size);
+  void split_bgr(StickerSprite &sprite);
+  void split_yuv(StickerSprite &sprite);
+  void split_bgra(StickerSprite &sprite);
+
+  GstVideoFormat format;
+
+  /* premultiplied BGRA, n_frames frames stacked vertically */
+  cv::Mat source;
+  int n_frames;
+
+  /* scratch images used while scaling */
+  cv::Mat scaled;
+  cv::Mat straight;
+  cv::Mat yuv;
+  cv::Mat alpha;
+  cv::Mat chroma_alpha;
+  std::vector<Entry> entries;
+  guint64 clock;
+};
+
+#endif /* __STICKER_CACHE_H__ */
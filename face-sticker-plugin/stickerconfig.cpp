@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <vector>
+
+#include <opencv2/core/version.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "stickeratlas.hpp"
+#include "stickercache.hpp"
+#include "stickerconfig.hpp"
+
+/* OpenCV reads animations with their alpha channel from 4.11 on; older
+ * versions go through VideoCapture, which only returns BGR */
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 11)
+#define HAVE_IMREADANIMATION 1
+#endif
+
+/* Frames kept from one animation or sprite sheet */
+#define STICKER_MAX_FRAMES 256
+
+ConfigStore::ConfigStore(const FaceStickerConfig &initial)
+    : current(std::make_shared<const FaceStickerConfig>(initial)) {}
+
+void ConfigStore::update(
+    const std::function<void(FaceStickerConfig &)> &change) {
+  std::lock_guard<std::mutex> guard(write_lock);
+  std::shared_ptr<FaceStickerConfig> next =
+      std::make_shared<FaceStickerConfig>(*current.load());
+
+  change(*next);
+  current.store(std::move(next), std::memory_order_release);
+}
+
+StickerLoader::StickerLoader(PublishFunc publish,
+                             AtlasPublishFunc publish_atlas)
+    : publish(std::move(publish)), publish_atlas(std::move(publish_atlas)),
+      running(true), has_pending(false), pending_columns(1), pending_rows(1),
+      has_pending_atlas(false), requested(0), published(0) {
+  thread = std::thread(&StickerLoader::run, this);
+}
+
+StickerLoader::~StickerLoader() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    running = false;
+  }
+  cond.notify_one();
+  thread.join();
+}
+
+void StickerLoader::load(const char *path, guint columns, guint rows,
+                         bool wait) {
+  std::unique_lock<std::mutex> guard(lock);
+  guint64 request = ++requested;
+
+  has_pending = true;
+  pending = path ? path : "";
+  pending_columns = columns;
+  pending_rows = rows;
+  cond.notify_one();
+
+  if (wait) {
+    wait_published(guard, request);
+  }
+}
+
+void StickerLoader::load_atlas(const char *path, bool wait) {
+  std::unique_lock<std::mutex> guard(lock);
+  guint64 request = ++requested;
+
+  has_pending_atlas = true;
+  pending_atlas = path ? path : "";
+  cond.notify_one();
+
+  if (wait) {
+    wait_published(guard, request);
+  }
+}
+
+void StickerLoader::wait_published(std::unique_lock<std::mutex> &guard,
+                                   guint64 request) {
+  published_cond.wait(guard, [this, request] { return published >= request; });
+}
+
+/* Cuts a sprite sheet into @columns x @rows equally sized cells. */
+static void split_sheet(const cv::Mat &sheet, guint columns, guint rows,
+                        std::vector<cv::Mat> &frames) {
+  int width = sheet.cols / columns;
+  int height = sheet.rows / rows;
+
+  if (width == 0 || height == 0) {
+    return;
+  }
+
+  for (guint row = 0; row < rows; row++) {
+    for (guint column = 0; column < columns; column++) {
+      frames.push_back(
+          sheet(cv::Rect(column * width, row * height, width, height)));
+    }
+  }
+}
+
+/* Reads every frame of an animated file. Leaves @frames empty when @path is
+ * not an animation, so that still images keep going through imread(). */
+static void read_animation(const char *path, std::vector<cv::Mat> &frames,
+                           gdouble &fps) {
+#ifdef HAVE_IMREADANIMATION
+  cv::Animation animation;
+
+  if (!cv::imreadanimation(path, animation, 0, STICKER_MAX_FRAMES) ||
+      animation.frames.size() < 2) {
+    return;
+  }
+
+  int total = 0;
+  for (int duration : animation.durations) {
+    total += duration;
+  }
+  if (total > 0) {
+    fps = animation.frames.size() * 1000.0 / total;
+  }
+  frames = std::move(animation.frames);
+#else
+  cv::VideoCapture capture(path);
+  cv::Mat frame;
+
+  if (!capture.isOpened()) {
+    return;
+  }
+
+  while (frames.size() < STICKER_MAX_FRAMES && capture.read(frame)) {
+    frames.push_back(frame.clone());
+  }
+  if (frames.size() < 2) {
+    frames.clear();
+    return;
+  }
+  fps = capture.get(cv::CAP_PROP_FPS);
+#endif
+}
+
+/* Decodes every frame up front and stacks them into one contiguous source,
+ * so that playing the animation never decodes or converts anything. */
+std::shared_ptr<const StickerAsset>
+StickerLoader::decode(const char *path, guint columns, guint rows) {
+  std::shared_ptr<StickerAsset> asset = std::make_shared<StickerAsset>();
+  std::vector<cv::Mat> frames;
+
+  if (!path || !*path) {
+    return asset;
+  }
+
+  asset->path = path;
+  asset->fps = 0;
+
+  if (columns * rows > 1) {
+    split_sheet(cv::imread(path, cv::IMREAD_UNCHANGED), columns, rows, frames);
+  } else {
+    read_animation(path, frames, asset->fps);
+    if (frames.empty()) {
+      frames.push_back(cv::imread(path, cv::IMREAD_UNCHANGED));
+    }
+  }
+
+  if (frames.size() > STICKER_MAX_FRAMES) {
+    frames.resize(STICKER_MAX_FRAMES);
+  }
+  if (frames.empty() || frames[0].empty()) {
+    return asset;
+  }
+
+  /* animation frames normally share the canvas size; make sure they do */
+  for (cv::Mat &frame : frames) {
+    if (frame.size() != frames[0].size()) {
+      cv::resize(frame, frame, frames[0].size());
+    }
+  }
+
+  cv::Mat stacked;
+  cv::vconcat(frames, stacked);
+
+  asset->source = StickerCache::prepare_source(stacked);
+  asset->n_frames = frames.size();
+  return asset;
+}
+
+void StickerLoader::run() {
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (true) {
+    cond.wait(guard, [this] { return requested > published || !running; });
+    if (!running) {
+      break;
+    }
+
+    bool sticker = has_pending;
+    std::string path;
+    path.swap(pending);
+    guint columns = pending_columns;
+    guint rows = pending_rows;
+    bool atlas = has_pending_atlas;
+    std::string atlas_path;
+    atlas_path.swap(pending_atlas);
+    guint64 request = requested;
+
+    has_pending = false;
+    has_pending_atlas = false;
+
+    guard.unlock();
+    if (sticker) {
+      publish(decode(path.c_str(), columns, rows));
+    }
+    if (atlas) {
+      std::shared_ptr<const StickerAtlas> loaded;
+      GError *error = NULL;
+
+      if (!atlas_path.empty()) {
+        loaded = StickerAtlas::load(atlas_path.c_str(), &error);
+      }
+      publish_atlas(atlas_path, std::move(loaded), error);
+      g_clear_error(&error);
+    }
+    guard.lock();
+
+    published = request;
+    published_cond.notify_all();
+  }
+}
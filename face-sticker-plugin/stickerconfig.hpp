@@ -0,0 +1,130 @@
+#ifndef __STICKER_CONFIG_H__
+#define __STICKER_CONFIG_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <glib.h>
+#include <opencv2/core/mat.hpp>
+
+#include "gstfacesticker.hpp"
+
+class StickerAtlas;
+
+/* A decoded sticker image, converted for StickerCache::use_source(). An
+ * animated sticker keeps its @n_frames frames stacked vertically in @source,
+ * one contiguous buffer; @fps is the animation's own rate, 0 when the file
+ * has none. Never modified once built, so its pixels may be shared by any
+ * thread. */
+typedef struct {
+  std::string path;
+  cv::Mat source;
+  int n_frames;
+  gdouble fps;
+} StickerAsset;
+
+/* The settings the streaming and detection threads read per frame. A
+ * published snapshot is never modified: writers copy it, change the copy and
+ * publish that. */
+typedef struct {
+  GstFaceStickerMode mode;
+  GstFaceStickerEffect effect;
+  /* stickers handed downstream as overlay composition meta */
+  gboolean overlay_composition;
+  std::shared_ptr<const StickerAsset> sticker;
+  /* replaces the eye stickers when set */
+  std::shared_ptr<const StickerAtlas> atlas;
+  gfloat eye_img_scale;
+  gdouble sticker_fps;
+  gint min_confidence;
+  gboolean silent;
+} FaceStickerConfig;
+
+/* Holds the current FaceStickerConfig snapshot. Readers take it with one
+ * atomic load and keep it alive for as long as they use it, never waiting
+ * for writers; writers are serialized among themselves. */
+class ConfigStore {
+public:
+  explicit ConfigStore(const FaceStickerConfig &initial);
+
+  ConfigStore(const ConfigStore &) = delete;
+  ConfigStore &operator=(const ConfigStore &) = delete;
+
+  std::shared_ptr<const FaceStickerConfig> load() const {
+    return current.load(std::memory_order_acquire);
+  }
+
+  /* Publishes a copy of the current snapshot with @change applied. */
+  void update(const std::function<void(FaceStickerConfig &)> &change);
+
+private:
+  std::atomic<std::shared_ptr<const FaceStickerConfig>> current;
+  std::mutex write_lock;
+};
+
+/* Decodes and converts sticker images and atlases on a background thread.
+ *
+ * Requests replace any of the same kind that has not started yet, so only
+ * the newest path of a burst is loaded, and results are published in
+ * request order. Each finished asset is handed to @publish on the loader
+ * thread; its source is empty when the image could not be read. Each atlas
+ * goes to @publish_atlas, NULL with @error set when it could not be loaded,
+ * and NULL without an error for an empty path.
+ *
+ * A sprite sheet is cut into @columns x @rows frames, read row by row.
+ * Otherwise animated files (GIF, APNG) are decoded frame by frame. */
+class StickerLoader {
+public:
+  typedef std::function<void(std::shared_ptr<const StickerAsset> asset)>
+      PublishFunc;
+  typedef std::function<void(const std::string &path,
+                             std::shared_ptr<const StickerAtlas> atlas,
+                             const GError *error)>
+      AtlasPublishFunc;
+
+  StickerLoader(PublishFunc publish, AtlasPublishFunc publish_atlas);
+  ~StickerLoader();
+
+  StickerLoader(const StickerLoader &) = delete;
+  StickerLoader &operator=(const StickerLoader &) = delete;
+
+  /* Queues @path. With @wait, returns only once it (or a later request)
+   * has been published. */
+  void load(const char *path, guint columns, guint rows, bool wait);
+
+  /* Same as load(), for the atlas key file at @path. */
+  void load_atlas(const char *path, bool wait);
+
+  static std::shared_ptr<const StickerAsset> decode(const char *path,
+                                                     guint columns,
+                                                     guint rows);
+
+private:
+  void run();
+  void wait_published(std::unique_lock<std::mutex> &guard, guint64 request);
+
+  PublishFunc publish;
+  AtlasPublishFunc publish_atlas;
+
+  std::mutex lock;
+  std::condition_variable cond;
+  std::condition_variable published_cond;
+  bool running;
+  bool has_pending;
+  std::string pending;
+  guint pending_columns;
+  guint pending_rows;
+  bool has_pending_atlas;
+  std::string pending_atlas;
+  guint64 requested;
+  guint64 published;
+
+  std::thread thread;
+};
+
+#endif /* __STICKER_CONFIG_H__ */